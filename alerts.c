@@ -0,0 +1,325 @@
+// Alert rules, from the [Alerts] group of gatotrayrc. One rule per key:
+//
+//   [Alerts]
+//   busy=cpu > 90 for 30s: blink
+//   low memory=mem_avail < 5 clear 8: notify
+//   leak=rss_growth(firefox) > 100 cooldown 10m: command logger "firefox is leaking"
+//   thrashing=psi_memory_full > 10: notify
+//
+//   <metric> <'>' or '<'> <threshold> [for <duration>] [clear <level>]
+//       [cooldown <duration>]: blink | notify | command <shell command>
+//
+// A rule fires once its condition has held for the "for" duration, then
+// stays active until the metric crosses back over the clear level (the
+// threshold by default), so values hovering at the threshold do not flap.
+// After firing it cannot fire again within the cooldown. Blink flashes a
+// frame around the tray icon while the rule is active; notify goes through
+// notify-send; commands run with GATOTRAY_ALERT and GATOTRAY_VALUE set.
+//
+// Rules are compiled once into a flat array: evaluating them on each sample
+// reads the snapshot and process list in place and allocates nothing.
+
+#include <math.h>
+
+typedef enum {
+    AM_CPU, AM_IOWAIT, AM_TEMP, AM_MEM_AVAIL, AM_NET_RX, AM_NET_TX, AM_PROCS,
+    AM_RSS, AM_RSS_GROWTH, // Summed over processes named like the argument
+    AM_PSI_SOME, AM_PSI_FULL,
+    AM_COUNT
+} AlertMetric;
+
+static const struct { const char *name, *unit; } alert_metrics[AM_COUNT] = {
+    [AM_CPU] = { "cpu", "%" },
+    [AM_IOWAIT] = { "iowait", "%" },
+    [AM_TEMP] = { "temp", "°C" },
+    [AM_MEM_AVAIL] = { "mem_avail", "%" },
+    [AM_NET_RX] = { "net_rx", "KB/s" },
+    [AM_NET_TX] = { "net_tx", "KB/s" },
+    [AM_PROCS] = { "procs", "" },
+    [AM_RSS] = { "rss", "MB" },
+    [AM_RSS_GROWTH] = { "rss_growth", "MB/min" },
+    [AM_PSI_SOME] = { "psi_memory_some", "%" },
+    [AM_PSI_FULL] = { "psi_memory_full", "%" },
+};
+
+typedef enum { AA_BLINK, AA_NOTIFY, AA_COMMAND } AlertAction;
+
+#define MAX_ALERTS 32
+#define ALERT_GROWTH_WINDOW_US (10 * G_USEC_PER_SEC) // Minimum span of an rss_growth sample
+
+typedef struct {
+    gchar* name;
+    AlertMetric metric;
+    char comm[32];          // AM_RSS and AM_RSS_GROWTH argument
+    gboolean below;         // '<' rule
+    double threshold, clear;
+    gint64 hold_us, cooldown_us;
+    AlertAction action;
+    gchar* command;
+    // State
+    gint64 since_us, fired_us;
+    gboolean active;
+    double growth, growth_base_mb; // AM_RSS_GROWTH rate and window start
+    gint64 growth_base_us;
+} AlertRule;
+
+static AlertRule alerts[MAX_ALERTS];
+static int n_alerts = 0;
+static gboolean alerts_need_psi = FALSE;
+
+static gboolean alert_parse_number(const char* s, double* v)
+{
+    char* end;
+    *v = g_ascii_strtod(s, &end);
+    return *s && !*end;
+}
+
+static gboolean alert_parse_duration(const char* s, gint64* us)
+{
+    long seconds = metrics_log_parse_step(s);
+    *us = seconds * G_USEC_PER_SEC;
+    return seconds > 0;
+}
+
+// Compiles one rule into *r. Returns an error message, or NULL.
+static const char* alert_compile(AlertRule* r, const char* spec)
+{
+    const char* colon = strchr(spec, ':');
+    if (!colon)
+        return "missing \": <action>\"";
+    gchar* cond = g_strndup(spec, colon - spec);
+    gchar** tok = g_strsplit_set(g_strstrip(cond), " \t", -1);
+    const char* error = NULL;
+    int n = 0;
+    for (int i = 0; tok[i]; i++) // Drop empty tokens from repeated blanks
+        if (*tok[i])
+            tok[n++] = tok[i];
+        else
+            g_free(tok[i]);
+    tok[n] = NULL;
+
+    char metric[32] = "";
+    const char* paren = n ? strchr(tok[0], '(') : NULL;
+    if (n)
+        g_strlcpy(metric, tok[0], MIN(sizeof(metric), paren ? paren - tok[0] + 1 : sizeof(metric)));
+    r->metric = 0;
+    while (r->metric < AM_COUNT && !g_str_equal(metric, alert_metrics[r->metric].name))
+        r->metric++;
+    gboolean per_comm = r->metric == AM_RSS || r->metric == AM_RSS_GROWTH;
+    if (r->metric == AM_COUNT)
+        error = "unknown metric";
+    else if (per_comm != (paren && g_str_has_suffix(paren, ")") && paren[1] != ')'))
+        error = per_comm ? "expected <metric>(<process name>)" : "unexpected argument";
+    else if (n < 3 || (!g_str_equal(tok[1], ">") && !g_str_equal(tok[1], "<")))
+        error = "expected <metric> > <value> or <metric> < <value>";
+    else if (!alert_parse_number(tok[2], &r->threshold))
+        error = "bad threshold";
+    if (paren && per_comm && !error)
+        g_strlcpy(r->comm, paren+1, MIN(sizeof(r->comm), strlen(paren+1)));
+    r->below = n > 1 && tok[1][0] == '<';
+    r->clear = r->threshold;
+    r->hold_us = r->cooldown_us = 0;
+    r->growth = NAN; // Until a whole growth window has passed
+    for (int i = 3; !error && i < n; i += 2) {
+        if (i+1 >= n)
+            error = "missing value";
+        else if (g_str_equal(tok[i], "for")) {
+            if (!alert_parse_duration(tok[i+1], &r->hold_us))
+                error = "bad duration, use e.g. 30s, 5m or 1h";
+        } else if (g_str_equal(tok[i], "cooldown")) {
+            if (!alert_parse_duration(tok[i+1], &r->cooldown_us))
+                error = "bad duration, use e.g. 30s, 5m or 1h";
+        } else if (g_str_equal(tok[i], "clear")) {
+            if (!alert_parse_number(tok[i+1], &r->clear)
+                    || (r->below ? r->clear < r->threshold : r->clear > r->threshold))
+                error = "clear level must be on the safe side of the threshold";
+        } else
+            error = "expected for, clear or cooldown";
+    }
+    g_strfreev(tok);
+    g_free(cond);
+    if (error)
+        return error;
+
+    const char* action = colon + 1;
+    while (*action == ' ' || *action == '\t')
+        action++;
+    r->command = NULL;
+    if (g_str_equal(action, "blink"))
+        r->action = AA_BLINK;
+    else if (g_str_equal(action, "notify"))
+        r->action = AA_NOTIFY;
+    else if (g_str_has_prefix(action, "command ") && action[8]) {
+        r->action = AA_COMMAND;
+        r->command = g_strdup(action + 8);
+    } else
+        return "unknown action, use blink, notify or command <shell command>";
+    return NULL;
+}
+
+// (Re)compiles the rules from the key file. Bad rules are reported and skipped.
+void alerts_load(GKeyFile* keys)
+{
+    for (int i = 0; i < n_alerts; i++) {
+        g_free(alerts[i].name);
+        g_free(alerts[i].command);
+    }
+    n_alerts = 0;
+    alerts_need_psi = FALSE;
+    gchar** names = g_key_file_get_keys(keys, "Alerts", NULL, NULL);
+    for (int i = 0; names && names[i]; i++) {
+        gchar* spec = g_key_file_get_string(keys, "Alerts", names[i], NULL);
+        if (n_alerts == MAX_ALERTS) {
+            g_warning("Alert \"%s\" ignored: at most %d rules", names[i], MAX_ALERTS);
+        } else if (spec) {
+            AlertRule* r = &alerts[n_alerts];
+            *r = (AlertRule){0};
+            const char* error = alert_compile(r, spec);
+            if (error)
+                g_warning("Alert \"%s\" ignored: %s in \"%s\"", names[i], error, spec);
+            else {
+                r->name = g_strdup(names[i]);
+                alerts_need_psi |= r->metric == AM_PSI_SOME || r->metric == AM_PSI_FULL;
+                n_alerts++;
+            }
+        }
+        g_free(spec);
+    }
+    g_strfreev(names);
+}
+
+// avg10 of /proc/pressure/memory, read once per evaluation
+static double alert_psi[2];
+
+static void alert_read_psi(void)
+{
+    static int fd = -2;
+    if (fd == -2)
+        fd = root_open("/proc/pressure/memory");
+    char buf[256];
+    int len = fd >= 0 ? pread(fd, buf, sizeof(buf)-1, 0) : -1;
+    alert_psi[0] = alert_psi[1] = NAN;
+    if (len <= 0)
+        return;
+    buf[len] = '\0';
+    const char* some = strstr(buf, "some avg10=");
+    const char* full = strstr(buf, "full avg10=");
+    if (some)
+        alert_psi[0] = g_ascii_strtod(some + 11, NULL);
+    if (full)
+        alert_psi[1] = g_ascii_strtod(full + 11, NULL);
+}
+
+static double alert_comm_rss_mb(const char* comm)
+{
+    double mb = 0;
+    for (const ProcessInfo* p = top_procs; p; p = p->next)
+        if (g_str_equal(p->comm, comm))
+            mb += p->rss * PAGE_GB() * 1024;
+    return mb;
+}
+
+// Current value of the rule's metric, NAN when unknown
+static double alert_value(AlertRule* r, gint64 now_us)
+{
+    switch (r->metric) {
+    case AM_CPU: return snapshot.cpu.usage * 100.0 / SCALE;
+    case AM_IOWAIT: return snapshot.cpu.iowait * 100.0 / SCALE;
+    case AM_TEMP: return snapshot.temp ? snapshot.temp : NAN;
+    case AM_MEM_AVAIL: return snapshot.mem.Total_MB
+        ? snapshot.mem.Available_MB * 100.0 / snapshot.mem.Total_MB : NAN;
+    case AM_NET_RX: return snapshot.net_rx_KBps;
+    case AM_NET_TX: return snapshot.net_tx_KBps;
+    case AM_PROCS: return snapshot_procs ? procs_total : NAN;
+    case AM_RSS: return snapshot_procs ? alert_comm_rss_mb(r->comm) : NAN;
+    case AM_RSS_GROWTH: {
+        if (!snapshot_procs)
+            return NAN;
+        double mb = alert_comm_rss_mb(r->comm);
+        if (!r->growth_base_us) {
+            r->growth_base_us = now_us;
+            r->growth_base_mb = mb;
+            return NAN;
+        }
+        if (now_us - r->growth_base_us >= ALERT_GROWTH_WINDOW_US) {
+            r->growth = (mb - r->growth_base_mb) * 60 * G_USEC_PER_SEC / (now_us - r->growth_base_us);
+            r->growth_base_us = now_us;
+            r->growth_base_mb = mb;
+        }
+        return r->growth;
+    }
+    case AM_PSI_SOME: return alert_psi[0];
+    case AM_PSI_FULL: return alert_psi[1];
+    default: return NAN;
+    }
+}
+
+static void alert_fire(const AlertRule* r, double value)
+{
+    char text[160];
+    snprintf(text, sizeof(text), "%s%s%s%s is %.1f%s (%c %g)", alert_metrics[r->metric].name,
+        r->comm[0] ? "(" : "", r->comm, r->comm[0] ? ")" : "",
+        value, alert_metrics[r->metric].unit, r->below ? '<' : '>', r->threshold);
+    g_message("Alert \"%s\": %s", r->name, text);
+    GError* error = NULL;
+    if (r->action == AA_NOTIFY) {
+        gchar* argv[] = { "notify-send", "-a", "gatotray", r->name, text, NULL };
+        g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, NULL, &error);
+    } else if (r->action == AA_COMMAND) {
+        char value_str[32];
+        snprintf(value_str, sizeof(value_str), "%.1f", value);
+        gchar** envp = g_environ_setenv(g_get_environ(), "GATOTRAY_ALERT", r->name, TRUE);
+        envp = g_environ_setenv(envp, "GATOTRAY_VALUE", value_str, TRUE);
+        gchar* argv[] = { "/bin/sh", "-c", r->command, NULL };
+        g_spawn_async(NULL, argv, envp, 0, NULL, NULL, NULL, &error);
+        g_strfreev(envp);
+    }
+    if (error) {
+        g_warning("Alert \"%s\" action failed: %s", r->name, error->message);
+        g_error_free(error);
+    }
+}
+
+// Called once per sample
+void alerts_evaluate(void)
+{
+    if (!n_alerts)
+        return;
+    gint64 now = g_get_monotonic_time();
+    if (alerts_need_psi)
+        alert_read_psi();
+    for (AlertRule* r = alerts; r < alerts + n_alerts; r++) {
+        double v = alert_value(r, now);
+        if (isnan(v)) {
+            r->since_us = 0;
+            continue;
+        }
+        if (r->active) {
+            if (r->below ? v >= r->clear : v <= r->clear)
+                r->active = FALSE;
+            continue;
+        }
+        if (r->below ? v >= r->threshold : v <= r->threshold) {
+            r->since_us = 0;
+            continue;
+        }
+        if (!r->since_us)
+            r->since_us = now;
+        if (now - r->since_us < r->hold_us
+                || (r->fired_us && now - r->fired_us < r->cooldown_us))
+            continue;
+        r->active = TRUE;
+        r->since_us = 0;
+        r->fired_us = now;
+        alert_fire(r, v);
+    }
+}
+
+// TRUE while any blink rule is active
+gboolean alerts_blinking(void)
+{
+    for (const AlertRule* r = alerts; r < alerts + n_alerts; r++)
+        if (r->active && r->action == AA_BLINK)
+            return TRUE;
+    return FALSE;
+}
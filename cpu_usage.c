@@ -22,49 +22,108 @@
 } while(0)
 
 typedef unsigned long long u64;
-typedef struct { int usage, iowait;  } CPU_Usage;
+// Fractions of all CPU time since the previous call. usage counts every busy
+// tick: user, nice and system as well as irq, softirq and guest, which are
+// also broken out on their own. steal is time the hypervisor gave to others.
+typedef struct { int usage, iowait, irq, softirq, steal, guest; } CPU_Usage;
+
+// Columns of the "cpu" line in /proc/stat, in order
+enum { CT_USER, CT_NICE, CT_SYSTEM, CT_IDLE, CT_IOWAIT, CT_IRQ, CT_SOFTIRQ,
+    CT_STEAL, CT_GUEST, CT_GUEST_NICE, CT_COUNT };
+
+// Scheduler activity from the rest of /proc/stat: context switches,
+// interrupts and forks per second since the previous call, and the tasks
+// running and blocked (uninterruptible, mostly on I/O) at the time of it
+typedef struct { int ctxt, intr, forks, running, blocked; } SchedStats;
 
 u64 cpu_busy_ticks=0;
 u64 cpu_iowait_ticks=0;
 u64 cpu_total_ticks=0;
+SchedStats sched_stats = {0};
 
-CPU_Usage
-cpu_usage(int scale)
+// Value after "\n<key> " in buf, 0 if missing
+static u64 proc_stat_field(const char* buf, const char* key)
 {
-    /* static stuff */
+    const char* p = strstr(buf, key);
+    return p ? strtoull(p + strlen(key), NULL, 10) : 0;
+}
 
-    static FILE *proc_stat = NULL;
-    if (!proc_stat) {
-        if (!(proc_stat = fopen("/proc/stat", "r")))
-            error(1, errno, "Could not open /proc/stat");
-    }
+static void sched_stats_update(const char* buf)
+{
+    static u64 prev_ctxt, prev_intr, prev_forks;
+    static gint64 prev_us = 0;
+    gint64 now_us = g_get_monotonic_time();
 
-    u64 busy, nice, system, idle, total;
-    u64 iowait=0, irq=0, softirq=0; /* New in Linux 2.6 */
-    if( 4 > fscanf(proc_stat, "cpu %Lu %Lu %Lu %Lu %Lu %Lu %Lu",
-                    &busy, &nice, &system, &idle, &iowait, &irq, &softirq))
-        error(1, errno, "Can't seem to read /proc/stat properly");
-    rewind(proc_stat);
-    fflush(proc_stat); // /proc files: rewind alone leaves stale buffer
+    // The intr line lists every interrupt source and may be tens of KB long:
+    // only its leading total is parsed, the later keys are searched past it
+    const char* intr = strstr(buf, "\nintr ");
+    u64 intr_total = intr ? strtoull(intr + 6, NULL, 10) : 0;
+    const char* rest = intr ? strchr(intr + 1, '\n') : buf;
+    if (!rest)
+        rest = buf;
+    u64 ctxt = proc_stat_field(rest, "\nctxt ");
+    u64 forks = proc_stat_field(rest, "\nprocesses ");
 
-    busy += nice+system+irq+softirq;
-    total = busy+idle+iowait;
+    double per_s = prev_us ? (double)G_USEC_PER_SEC / MAX(now_us - prev_us, 1) : 0;
+    #define rate(now, before) ((now) > (before) ? (int)MIN(((now) - (before)) * per_s, G_MAXINT) : 0)
+    sched_stats.ctxt = rate(ctxt, prev_ctxt);
+    sched_stats.intr = rate(intr_total, prev_intr);
+    sched_stats.forks = rate(forks, prev_forks);
+    #undef rate
+    sched_stats.running = proc_stat_field(rest, "\nprocs_running ");
+    sched_stats.blocked = proc_stat_field(rest, "\nprocs_blocked ");
 
-    CPU_Usage cpu;
+    prev_ctxt = ctxt;
+    prev_intr = intr_total;
+    prev_forks = forks;
+    prev_us = now_us;
+}
+
+CPU_Usage
+cpu_usage(int scale)
+{
+    static RtFile proc_stat = RT_FILE("/proc/stat");
+    static u64 prev[CT_COUNT];
+    // The whole file, for sched_stats: the kernel formats all of it anyway
+    static char* buf = NULL;
+    static size_t size = 16384;
+    int len;
+    if (!buf)
+        buf = g_malloc(size);
+    while ((len = rt_file_read(&proc_stat, buf, size)) == (int)size - 1)
+        buf = g_realloc(buf, size *= 2); // Many interrupt sources
+    if (len < 0)
+        error(1, errno, "Could not read /proc/stat");
+
+    // Older kernels have fewer columns: the missing ones stay 0
+    u64 t[CT_COUNT] = {0};
+    if( 4 > sscanf(buf, "cpu %Lu %Lu %Lu %Lu %Lu %Lu %Lu %Lu %Lu %Lu",
+                    &t[CT_USER], &t[CT_NICE], &t[CT_SYSTEM], &t[CT_IDLE], &t[CT_IOWAIT],
+                    &t[CT_IRQ], &t[CT_SOFTIRQ], &t[CT_STEAL], &t[CT_GUEST], &t[CT_GUEST_NICE]))
+        error(1, errno, "Can't seem to read /proc/stat properly");
 
-    if( busy > cpu_busy_ticks )
-        cpu.usage = (u64)scale * (busy - cpu_busy_ticks) / (total - cpu_total_ticks);
-    else
-        cpu.usage = 0;
+    // guest and guest_nice are already part of user and nice
+    u64 busy = t[CT_USER]+t[CT_NICE]+t[CT_SYSTEM]+t[CT_IRQ]+t[CT_SOFTIRQ];
+    u64 total = busy+t[CT_IDLE]+t[CT_IOWAIT]+t[CT_STEAL];
+    u64 elapsed = total > cpu_total_ticks ? total - cpu_total_ticks : 0;
 
-    if( iowait > cpu_iowait_ticks )
-        cpu.iowait = (u64)scale * (iowait - cpu_iowait_ticks) / (total - cpu_total_ticks);
-    else
-        cpu.iowait = 0;
+    // Counters may step back (e.g. iowait on some kernels): clamp at 0
+    #define fraction(now, before) ((now) > (before) && elapsed ? (u64)scale * ((now) - (before)) / elapsed : 0)
+    CPU_Usage cpu = {
+        .usage = fraction(busy, cpu_busy_ticks),
+        .iowait = fraction(t[CT_IOWAIT], prev[CT_IOWAIT]),
+        .irq = fraction(t[CT_IRQ], prev[CT_IRQ]),
+        .softirq = fraction(t[CT_SOFTIRQ], prev[CT_SOFTIRQ]),
+        .steal = fraction(t[CT_STEAL], prev[CT_STEAL]),
+        .guest = fraction(t[CT_GUEST]+t[CT_GUEST_NICE], prev[CT_GUEST]+prev[CT_GUEST_NICE]),
+    };
+    #undef fraction
 
+    memcpy(prev, t, sizeof(prev));
     cpu_busy_ticks = busy;
-    cpu_iowait_ticks = iowait;
+    cpu_iowait_ticks = t[CT_IOWAIT];
     cpu_total_ticks = total;
+    sched_stats_update(buf);
 
     return cpu;
 }
@@ -72,14 +131,13 @@ cpu_usage(int scale)
 int
 file_read_int(const char* file, int on_error)
 {
-    FILE* fp = fopen(file, "r");
-    if (fp) {
-        int i;
-        if (fscanf(fp, "%d", &i)) {
-            fclose(fp);
-            return i;
-        }
-    }
+    RtFile f = RT_FILE(file);
+    char buf[32];
+    int i;
+    gboolean ok = rt_file_read(&f, buf, sizeof(buf)) > 0 && sscanf(buf, "%d", &i) == 1;
+    rt_file_set_path(&f, NULL);
+    if (ok)
+        return i;
     error(0, errno, "Can't read uint from %s", file);
     return on_error;
 }
@@ -95,32 +153,26 @@ cpu_freq(void)
     if (scaling_cur_freq < 0)
         return 0; // Do not insist
 
-    static FILE *cur_freq_file = NULL;
-    if (!cur_freq_file) {
-        cur_freq_file = fopen("/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq","r");
-    }
-    if (cur_freq_file) {
-        rewind(cur_freq_file);
-        fflush(cur_freq_file);
-        if (fscanf(cur_freq_file, "%d", &scaling_cur_freq) == 1) {
-            if (scaling_max_freq) {
-                scaling_cur_freq /= 1000; // KHz -> MHz
-                if (scaling_cur_freq < scaling_min_freq)
-                    scaling_min_freq = scaling_cur_freq;
-                if (scaling_cur_freq > scaling_max_freq)
-                    scaling_max_freq = scaling_cur_freq;
-            } else {
-                scaling_min_freq =
-                    file_read_int("/sys/devices/system/cpu/cpu0/cpufreq/scaling_min_freq", scaling_cur_freq) / 1000;
-                scaling_max_freq =
-                    file_read_int("/sys/devices/system/cpu/cpu0/cpufreq/scaling_max_freq", scaling_cur_freq) / 1000;
-                scaling_cur_freq /= 1000; // KHz -> MHz
-            }
-            return scaling_cur_freq;
+    static RtFile cur_freq_file = RT_FILE("/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq");
+    char buf[32];
+    if (rt_file_read(&cur_freq_file, buf, sizeof(buf)) > 0
+            && sscanf(buf, "%d", &scaling_cur_freq) == 1) {
+        if (scaling_max_freq) {
+            scaling_cur_freq /= 1000; // KHz -> MHz
+            if (scaling_cur_freq < scaling_min_freq)
+                scaling_min_freq = scaling_cur_freq;
+            if (scaling_cur_freq > scaling_max_freq)
+                scaling_max_freq = scaling_cur_freq;
+        } else {
+            scaling_min_freq =
+                file_read_int("/sys/devices/system/cpu/cpu0/cpufreq/scaling_min_freq", scaling_cur_freq) / 1000;
+            scaling_max_freq =
+                file_read_int("/sys/devices/system/cpu/cpu0/cpufreq/scaling_max_freq", scaling_cur_freq) / 1000;
+            scaling_cur_freq /= 1000; // KHz -> MHz
         }
-        fclose(cur_freq_file);
-        cur_freq_file = NULL;
+        return scaling_cur_freq;
     }
+    rt_file_set_path(&cur_freq_file, NULL);
     scaling_cur_freq = -1; // Do not waste efforts retrying
     return 0;
 }
@@ -162,7 +214,7 @@ char** discover_temp_sensors(int* count, char*** labels) {
     char** label_list = g_malloc(capacity * sizeof(char*));
     
     for (int i = 0; i < G_N_ELEMENTS(temp_sensor_paths); i++) {
-        FILE* f = fopen(temp_sensor_paths[i].path, "r");
+        FILE* f = root_fopen(temp_sensor_paths[i].path);
         if (f) {
             fclose(f);
             
@@ -186,7 +238,7 @@ char** discover_temp_sensors(int* count, char*** labels) {
                     if (slash) {
                         int hwmon_len = slash - hwmon_dir;
                         snprintf(name_path, sizeof(name_path), "/sys/class/hwmon/%.*s/name", hwmon_len, hwmon_dir);
-                        FILE* name_file = fopen(name_path, "r");
+                        FILE* name_file = root_fopen(name_path);
                         if (name_file) {
                             if (fgets(sensor_name, sizeof(sensor_name), name_file)) {
                                 // Remove trailing newline
@@ -229,54 +281,52 @@ cpu_temperature(void)
     if (unavailable) return 0;
 
     int T = 0;
-    static FILE* temperature_file = NULL;
+    static RtFile temperature_file = RT_FILE(NULL);
     static const char* format = "temperature: %d C"; // ACPI format by default
     static char* current_path = NULL;
-    
+    static const char* default_paths[] = {
+        "/sys/class/hwmon/hwmon0/device/temp1_input",
+        "/sys/class/hwmon/hwmon1/device/temp1_input",
+        "/sys/class/hwmon/hwmon0/temp1_input",
+        "/sys/class/hwmon/hwmon1/temp1_input",
+        "/sys/class/thermal/thermal_zone0/temp",
+        "/proc/acpi/thermal_zone/THM/temperature",
+        "/proc/acpi/thermal_zone/THM0/temperature",
+        "/proc/acpi/thermal_zone/THRM/temperature",
+    };
+    char buf[64];
+
     // Check if the preference changed
     if (current_path != pref_temp_sensor_path) {
-        if (temperature_file) {
-            fclose(temperature_file);
-            temperature_file = NULL;
-        }
+        rt_file_set_path(&temperature_file, NULL);
         current_path = pref_temp_sensor_path;
     }
-    
-    if (!temperature_file) {
+
+    if (!temperature_file.path) {
         if (pref_temp_sensor_path && pref_temp_sensor_path[0]) {
             // Try to open the user-selected sensor
-            temperature_file = fopen(pref_temp_sensor_path, "r");
-            if (temperature_file) {
-                if (1 != fscanf(temperature_file, format, &T))
-                    format = "%d"; // Fallback to simple int
-            } else {
+            rt_file_set_path(&temperature_file, pref_temp_sensor_path);
+            if (rt_file_read(&temperature_file, buf, sizeof(buf)) < 0) {
                 g_message("Failed to open selected temperature sensor: %s", pref_temp_sensor_path);
+                rt_file_set_path(&temperature_file, NULL);
             }
         }
-        
+
         // If no preference set or failed to open, try defaults
-        if (!temperature_file) {
-            if ((temperature_file = fopen("/sys/class/hwmon/hwmon0/device/temp1_input", "r"))
-             || (temperature_file = fopen("/sys/class/hwmon/hwmon1/device/temp1_input", "r"))
-             || (temperature_file = fopen("/sys/class/hwmon/hwmon0/temp1_input", "r"))
-             || (temperature_file = fopen("/sys/class/hwmon/hwmon1/temp1_input", "r"))
-             || (temperature_file = fopen("/sys/class/thermal/thermal_zone0/temp", "r"))
-             || (temperature_file = fopen("/proc/acpi/thermal_zone/THM/temperature", "r"))
-             || (temperature_file = fopen("/proc/acpi/thermal_zone/THM0/temperature", "r"))
-             || (temperature_file = fopen("/proc/acpi/thermal_zone/THRM/temperature", "r")))
-            {
-                if (1 != fscanf(temperature_file, format, &T))
-                    format = "%d"; // Fallback to simple int
-            } else {
-                unavailable = TRUE;
-                return 0;
-            }
+        for (int i = 0; !temperature_file.path && i < G_N_ELEMENTS(default_paths); i++) {
+            rt_file_set_path(&temperature_file, default_paths[i]);
+            if (rt_file_read(&temperature_file, buf, sizeof(buf)) < 0)
+                rt_file_set_path(&temperature_file, NULL);
+        }
+        if (!temperature_file.path) {
+            unavailable = TRUE;
+            return 0;
         }
+        if (1 != sscanf(buf, format, &T))
+            format = "%d"; // Fallback to simple int
     }
 
-    rewind(temperature_file);
-    fflush(temperature_file);
-    if (1==fscanf(temperature_file, format, &T)) {
+    if (rt_file_read(&temperature_file, buf, sizeof(buf)) > 0 && 1==sscanf(buf, format, &T)) {
         if (T>1000) T=(T+500)/1000;
         return T;
     }
@@ -295,23 +345,22 @@ mem_info(void)
     if (unavailable)
         return meminfo;
 
-    static FILE* proc_meminfo = NULL;
-    if (proc_meminfo || (proc_meminfo = fopen("/proc/meminfo", "r")))
+    static RtFile proc_meminfo = RT_FILE("/proc/meminfo");
+    char buf[256]; // MemTotal, MemFree and MemAvailable lead the file
+    if (rt_file_read(&proc_meminfo, buf, sizeof(buf)) > 0)
     {
-        int total, free;
-        if (2==fscanf(proc_meminfo, "MemTotal: %d kB\nMemFree: %d kB\n", &total, &free))
+        int total, free, avail;
+        int n = sscanf(buf, "MemTotal: %d kB\nMemFree: %d kB\nMemAvailable: %d kB\n", &total, &free, &avail);
+        if (n >= 2)
         {
             meminfo.Total_MB = total >> 10;
             meminfo.Free_MB = free >> 10;
-            if (1==fscanf(proc_meminfo, "MemAvailable: %d kB\n", &free))
-                meminfo.Available_MB = free >> 10;
+            if (n == 3)
+                meminfo.Available_MB = avail >> 10;
             else
                 meminfo.Available_MB = meminfo.Free_MB; // Fallback on older kernels
-            rewind(proc_meminfo);
-            fflush(proc_meminfo);
             return meminfo;
         }
-        fclose(proc_meminfo);
     }
     error(0, errno, "Can't read /proc/meminfo");
     unavailable = TRUE;
@@ -0,0 +1,302 @@
+// OpenMetrics exporter: --listen unix:<path> or tcp:<port> (loopback only)
+// serves the latest sample to scrapers, over HTTP/1.0, at any URL.
+// Pages are formatted from memory only (snapshot, interface counters, top
+// processes) at most once per sample, into a buffer that keeps its size
+// across samples. Sockets are non-blocking and driven by the main loop, so a
+// slow or stuck scraper never delays sampling or drawing.
+
+#include <glib-unix.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#define EXPORTER_MAX_CONNS 8 // The oldest connection is dropped beyond this
+
+// Refcounted, so a scraper still being served keeps its page after the next sample
+typedef struct { int refs; gsize len; char data[]; } ExporterPage;
+
+typedef struct {
+    int fd;
+    guint source;
+    guint32 tail;       // Last 4 request bytes, to spot the blank line ending the headers
+    ExporterPage* page; // NULL while still reading the request
+    gsize sent;
+} ExporterConn;
+
+static ExporterConn exporter_conns[EXPORTER_MAX_CONNS]; // In accept order
+static int exporter_n_conns = 0;
+static GString* exporter_buf = NULL;
+static ExporterPage* exporter_page = NULL;
+static unsigned exporter_page_generation = 0;
+
+static void exporter_page_unref(ExporterPage* page)
+{
+    if (page && !--page->refs)
+        g_free(page);
+}
+
+static void om_family(GString* out, const char* name, const char* type, const char* help)
+{
+    g_string_append_printf(out, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+static void om_label_value(GString* out, const char* s)
+{
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            g_string_append_c(out, '\\');
+        g_string_append_c(out, *s);
+    }
+}
+
+static void om_process(GString* out, const char* name, const ProcessInfo* p, const char* fmt, double value)
+{
+    g_string_append_printf(out, "%s{pid=\"%u\",comm=\"", name, p->pid);
+    om_label_value(out, p->comm);
+    g_string_append(out, "\"} ");
+    g_string_append_printf(out, fmt, value);
+    g_string_append_c(out, '\n');
+}
+
+static void om_top(GString* out, const char* name, const char* help, const ProcessInfo* p, const char* fmt, double value)
+{
+    if (!p)
+        return;
+    om_family(out, name, "gauge", help);
+    om_process(out, name, p, fmt, value);
+}
+
+// A summary family from a quantiles.c sketch, values multiplied by scale
+static void om_quantiles(GString* out, const char* name, const char* help, QuantileMetric m, double scale)
+{
+    const QuantileSketch* s = quantile_sketch(m);
+    if (!s)
+        return;
+    om_family(out, name, "summary", help);
+    for (int i = 0; i < G_N_ELEMENTS(quantile_p); i++)
+        g_string_append_printf(out, "%s{quantile=\"%g\"} %g\n", name, quantile_p[i], quantile_get(s, i) * scale);
+    g_string_append_printf(out, "%s_sum %g\n%s_count %d\n", name, s->sum * scale, name, s->count);
+}
+
+static ExporterPage* exporter_page_get(void)
+{
+    if (exporter_page && exporter_page_generation == snapshot.generation)
+        return exporter_page;
+    exporter_page_generation = snapshot.generation;
+    if (!exporter_buf)
+        exporter_buf = g_string_sized_new(16384);
+    GString* out = exporter_buf;
+    g_string_set_size(out, 0);
+
+    om_family(out, "gatotray_cpu_usage_ratio", "gauge", "Busy CPU time fraction, iowait excluded");
+    g_string_append_printf(out, "gatotray_cpu_usage_ratio %.4f\n", (double)snapshot.cpu.usage / SCALE);
+    om_family(out, "gatotray_cpu_iowait_ratio", "gauge", "CPU time fraction spent waiting for I/O");
+    g_string_append_printf(out, "gatotray_cpu_iowait_ratio %.4f\n", (double)snapshot.cpu.iowait / SCALE);
+    om_family(out, "gatotray_cpu_mode_ratio", "gauge", "CPU time fraction by mode; irq, softirq and guest are part of usage");
+    g_string_append_printf(out, "gatotray_cpu_mode_ratio{mode=\"irq\"} %.4f\n", (double)snapshot.cpu.irq / SCALE);
+    g_string_append_printf(out, "gatotray_cpu_mode_ratio{mode=\"softirq\"} %.4f\n", (double)snapshot.cpu.softirq / SCALE);
+    g_string_append_printf(out, "gatotray_cpu_mode_ratio{mode=\"guest\"} %.4f\n", (double)snapshot.cpu.guest / SCALE);
+    g_string_append_printf(out, "gatotray_cpu_mode_ratio{mode=\"steal\"} %.4f\n", (double)snapshot.cpu.steal / SCALE);
+    om_family(out, "gatotray_context_switches_per_second", "gauge", "System-wide context switch rate");
+    g_string_append_printf(out, "gatotray_context_switches_per_second %d\n", snapshot.sched.ctxt);
+    om_family(out, "gatotray_interrupts_per_second", "gauge", "System-wide interrupt rate");
+    g_string_append_printf(out, "gatotray_interrupts_per_second %d\n", snapshot.sched.intr);
+    om_family(out, "gatotray_forks_per_second", "gauge", "Processes and threads created per second");
+    g_string_append_printf(out, "gatotray_forks_per_second %d\n", snapshot.sched.forks);
+    om_family(out, "gatotray_tasks", "gauge", "Tasks runnable or blocked in uninterruptible sleep");
+    g_string_append_printf(out, "gatotray_tasks{state=\"running\"} %d\n", snapshot.sched.running);
+    g_string_append_printf(out, "gatotray_tasks{state=\"blocked\"} %d\n", snapshot.sched.blocked);
+    if (snapshot.freq_MHz) {
+        om_family(out, "gatotray_cpu_frequency_hertz", "gauge", "Current frequency of cpu0");
+        g_string_append_printf(out, "gatotray_cpu_frequency_hertz %d000000\n", snapshot.freq_MHz);
+    }
+    if (snapshot.temp) {
+        om_family(out, "gatotray_temperature_celsius", "gauge", "Selected temperature sensor");
+        g_string_append_printf(out, "gatotray_temperature_celsius %d\n", snapshot.temp);
+    }
+    if (snapshot.mem.Total_MB) {
+        om_family(out, "gatotray_memory_total_bytes", "gauge", "MemTotal from /proc/meminfo");
+        g_string_append_printf(out, "gatotray_memory_total_bytes %" G_GINT64_FORMAT "\n", (gint64)snapshot.mem.Total_MB << 20);
+        om_family(out, "gatotray_memory_available_bytes", "gauge", "MemAvailable from /proc/meminfo");
+        g_string_append_printf(out, "gatotray_memory_available_bytes %" G_GINT64_FORMAT "\n", (gint64)snapshot.mem.Available_MB << 20);
+    }
+
+    // Percentiles over the quantiles.c window
+    om_quantiles(out, "gatotray_cpu_usage_ratio_window", "Busy CPU fraction percentiles", QM_CPU, .01);
+    om_quantiles(out, "gatotray_cpu_iowait_ratio_window", "I/O wait fraction percentiles", QM_IOWAIT, .01);
+    om_quantiles(out, "gatotray_temperature_celsius_window", "Temperature percentiles", QM_TEMP, 1);
+    om_quantiles(out, "gatotray_network_receive_bytes_per_second_window", "Receive rate percentiles", QM_NET_RX, 1024);
+    om_quantiles(out, "gatotray_network_transmit_bytes_per_second_window", "Transmit rate percentiles", QM_NET_TX, 1024);
+    om_quantiles(out, "gatotray_sample_duration_seconds_window", "Time taken by each sample", QM_LATENCY, 1e-3);
+
+    // Interface counters as read on the last sample; scrapers derive rates
+    om_family(out, "gatotray_network_receive_bytes", "counter", "Bytes received per interface");
+    for (int i = 0; i < n_ifaces; i++) {
+        g_string_append(out, "gatotray_network_receive_bytes_total{interface=\"");
+        om_label_value(out, iface_prev[i].name);
+        g_string_append_printf(out, "\"} %llu\n", iface_prev[i].rx);
+    }
+    om_family(out, "gatotray_network_transmit_bytes", "counter", "Bytes transmitted per interface");
+    for (int i = 0; i < n_ifaces; i++) {
+        g_string_append(out, "gatotray_network_transmit_bytes_total{interface=\"");
+        om_label_value(out, iface_prev[i].name);
+        g_string_append_printf(out, "\"} %llu\n", iface_prev[i].tx);
+    }
+
+    if (snapshot_procs) {
+        om_family(out, "gatotray_processes", "gauge", "Processes seen on the last /proc walk");
+        g_string_append_printf(out, "gatotray_processes %d\n", procs_total);
+        om_family(out, "gatotray_processes_active", "gauge", "Processes that used CPU since the previous walk");
+        g_string_append_printf(out, "gatotray_processes_active %d\n", procs_active);
+
+        // Per-process TCP bandwidth, for processes that had any
+        om_family(out, "gatotray_process_network_receive_bytes_per_second", "gauge", "TCP receive rate per process");
+        for (ProcessInfo* p = top_procs; p; p = p->next)
+            if (p->net_rx_KBps)
+                om_process(out, "gatotray_process_network_receive_bytes_per_second", p, "%.0f", p->net_rx_KBps * 1024.0);
+        om_family(out, "gatotray_process_network_transmit_bytes_per_second", "gauge", "TCP transmit rate per process");
+        for (ProcessInfo* p = top_procs; p; p = p->next)
+            if (p->net_tx_KBps)
+                om_process(out, "gatotray_process_network_transmit_bytes_per_second", p, "%.0f", p->net_tx_KBps * 1024.0);
+
+        const double page_bytes = PAGE_GB() * (1<<30);
+        om_top(out, "gatotray_top_cpu_ratio", "Top CPU consumer", top_cpu, "%.4f", top_cpu ? top_cpu->cpu / 100 : 0);
+        om_top(out, "gatotray_top_cpu_5m_ratio", "Top CPU consumer over the last 5 minutes", top_load, "%.4f", top_load ? CPU_LOAD(top_load, 1) / 100 : 0);
+        om_top(out, "gatotray_top_iowait_ratio", "Top I/O waiter", top_io, "%.4f", top_io ? top_io->io_wait / 100 : 0);
+        om_top(out, "gatotray_top_memory_rss_bytes", "Resident set size of the top memory user, ranked by PSS", top_mem, "%.0f", top_mem ? top_mem->rss * page_bytes : 0);
+        om_top(out, "gatotray_top_memory_pss_bytes", "Proportional set size of the top memory user, 0 when unreadable", top_mem, "%.0f", top_mem ? top_mem->pss * page_bytes : 0);
+        om_top(out, "gatotray_top_memory_growth_bytes_per_second", "Fastest rss growth, smoothed over minutes", top_growth, "%.0f", top_growth ? top_growth->rss_trend / 256.0 * page_bytes / 60 : 0);
+        om_top(out, "gatotray_top_open_fds", "Top file descriptor user", top_fds, "%.0f", top_fds ? top_fds->fd_count : 0);
+        om_top(out, "gatotray_top_threads", "Top thread count", top_threads, "%.0f", top_threads ? top_threads->thread_count : 0);
+        om_top(out, "gatotray_top_sockets", "Top socket user", top_sockets, "%.0f", top_sockets ? top_sockets->socket_count : 0);
+    }
+    g_string_append(out, "# EOF\n");
+
+    char header[192];
+    int header_len = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+        "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+        "Content-Length: %u\r\n\r\n", (unsigned)out->len);
+    exporter_page_unref(exporter_page);
+    exporter_page = g_malloc(sizeof(ExporterPage) + header_len + out->len);
+    exporter_page->refs = 1; // Held by the cache
+    exporter_page->len = header_len + out->len;
+    memcpy(exporter_page->data, header, header_len);
+    memcpy(exporter_page->data + header_len, out->str, out->len);
+    return exporter_page;
+}
+
+static void exporter_close(int i)
+{
+    ExporterConn* c = &exporter_conns[i];
+    if (c->source)
+        g_source_remove(c->source);
+    close(c->fd);
+    exporter_page_unref(c->page);
+    memmove(c, c+1, (--exporter_n_conns - i) * sizeof(*c));
+}
+
+static gboolean exporter_io_cb(gint fd, GIOCondition condition, gpointer data)
+{
+    int i = 0;
+    while (i < exporter_n_conns && exporter_conns[i].fd != fd)
+        i++;
+    if (i == exporter_n_conns)
+        return G_SOURCE_REMOVE;
+    ExporterConn* c = &exporter_conns[i];
+
+    if (!c->page) {
+        char buf[1024];
+        ssize_t n;
+        gboolean end = FALSE;
+        while (!end && (n = recv(fd, buf, sizeof(buf), 0)) > 0)
+            for (int k = 0; k < n; k++) {
+                c->tail = c->tail << 8 | (guchar)buf[k];
+                end |= c->tail == 0x0D0A0D0A || (c->tail & 0xFFFF) == 0x0A0A;
+            }
+        if (!end) {
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                return G_SOURCE_CONTINUE;
+            c->source = 0; // Closed or failed before asking
+            exporter_close(i);
+            return G_SOURCE_REMOVE;
+        }
+        c->page = exporter_page_get();
+        c->page->refs++;
+    }
+
+    while (c->sent < c->page->len) {
+        ssize_t n = send(fd, c->page->data + c->sent, c->page->len - c->sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (condition & G_IO_OUT)
+                return G_SOURCE_CONTINUE;
+            c->source = g_unix_fd_add(fd, G_IO_OUT, exporter_io_cb, NULL);
+            return G_SOURCE_REMOVE; // Replaced by the G_IO_OUT watch
+        }
+        if (n <= 0)
+            break;
+        c->sent += n;
+    }
+    c->source = 0;
+    exporter_close(i);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean exporter_accept_cb(gint listen_fd, GIOCondition condition, gpointer data)
+{
+    int fd;
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        if (exporter_n_conns == EXPORTER_MAX_CONNS)
+            exporter_close(0);
+        exporter_conns[exporter_n_conns++] = (ExporterConn) {
+            .fd = fd, .source = g_unix_fd_add(fd, G_IO_IN, exporter_io_cb, NULL) };
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Starts serving on "unix:<path>" or "tcp:<port>". Returns FALSE with a message on failure.
+gboolean exporter_listen(const char* spec)
+{
+    int fd = -1;
+    if (g_str_has_prefix(spec, "unix:")) {
+        const char* path = spec + 5;
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        if (!*path || strlen(path) >= sizeof(addr.sun_path)) {
+            g_printerr("Invalid socket path \"%s\"\n", path);
+            return FALSE;
+        }
+        strcpy(addr.sun_path, path);
+        struct stat st;
+        if (!lstat(path, &st) && S_ISSOCK(st.st_mode))
+            unlink(path); // Left behind by a previous run
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, 16))) {
+            close(fd);
+            fd = -1;
+        }
+    } else if (g_str_has_prefix(spec, "tcp:") && atoi(spec + 4) > 0 && atoi(spec + 4) < 65536) {
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(atoi(spec + 4)),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+        int on = 1;
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on))
+                || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, 16))) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        g_printerr("Usage: --listen unix:<path> | tcp:<port>\n");
+        return FALSE;
+    }
+    if (fd < 0) {
+        g_printerr("Cannot listen on %s: %s\n", spec, g_strerror(errno));
+        return FALSE;
+    }
+    g_unix_fd_add(fd, G_IO_IN, exporter_accept_cb, NULL);
+    return TRUE;
+}
@@ -0,0 +1,388 @@
+/*
+ * Collector benchmarks over a synthetic procfs/sysfs fixture.
+ *
+ *   make bench                     # built-in scales: 1k, 10k and 100k pids
+ *   ./gatotray-bench [-f fds] [-s sockets] [-i ifaces] [-t ticks] [pids...]
+ *
+ * Each scale runs in a child process that generates proc/ and sys/ fixture
+ * trees in a fresh temporary directory (on tmpfs when available), makes it
+ * the collectors' root with root_set() and times them headless. Reports ns
+ * per tick, ns per process and heap allocations per tick.
+ *
+ * Every pid gets stat, smaps_rollup, oom_score_adj and fd/; the first
+ * FIXTURE_BUSY_PIDS also get FIXTURE_BUSY_THREADS task/ entries that burn
+ * CPU, for the per-thread breakdown. That is about 12 KB of tmpfs per pid with
+ * the default 4 fds, so the 100k scale needs some 1.2 GB.
+ */
+#define main gatotray_main
+#include "gatotray.c"
+#undef main
+
+#include <stdarg.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Heap allocations are counted by interposing glibc's malloc family
+extern void* __libc_malloc(size_t);
+extern void* __libc_calloc(size_t, size_t);
+extern void* __libc_realloc(void*, size_t);
+static unsigned long bench_allocs = 0;
+void* malloc(size_t n) { bench_allocs++; return __libc_malloc(n); }
+void* calloc(size_t n, size_t s) { bench_allocs++; return __libc_calloc(n, s); }
+void* realloc(void* p, size_t n) { bench_allocs++; return __libc_realloc(p, n); }
+
+#define FIXTURE_BUSY_PIDS 4
+#define FIXTURE_BUSY_THREADS 64
+
+static int fds_per_proc = 4, socks_per_proc = 1, fixture_ifaces = 4, ticks = 5;
+
+static void G_GNUC_PRINTF(2, 3) write_file(const char* path, const char* fmt, ...)
+{
+    FILE* f = fopen(path, "w");
+    if (!f)
+        g_error("Cannot write %s: %s", path, g_strerror(errno));
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(f, fmt, args);
+    va_end(args);
+    fclose(f);
+}
+
+// Counters advance every tick so rate computations see realistic deltas
+static void fixture_tick(unsigned tick)
+{
+    write_file("proc/stat", "cpu  %u 0 %u %u %u 0 0 0 0 0\n",
+        1000 + tick*300, 500 + tick*100, 10000 + tick*600, 100 + tick*10);
+    GString* dev = g_string_new("Inter-|   Receive                                                |  Transmit\n"
+        " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n"
+        "    lo: 1000 10 0 0 0 0 0 0 1000 10 0 0 0 0 0 0\n");
+    for (int i = 0; i < fixture_ifaces; i++)
+        g_string_append_printf(dev, "  eth%d: %u 1000 0 0 0 0 0 0 %u 1000 0 0 0 0 0 0\n",
+            i, tick * 1250000u * (i+1), tick * 250000u * (i+1));
+    write_file("proc/net/dev", "%s", dev->str);
+    g_string_free(dev, TRUE);
+}
+
+static unsigned fixture_first_pid = 1000;
+
+static gboolean fixture_busy(unsigned pid)
+{
+    return pid - fixture_first_pid < FIXTURE_BUSY_PIDS;
+}
+
+static unsigned fixture_rss(unsigned pid)
+{
+    return 100 + pid % 5000;
+}
+
+// Fields used by ProcessInfo_scan: utime(14) stime(15) num_threads(20)
+// starttime(22) rss(24) delayacct_blkio_ticks(42). thread_scan() takes
+// utime and stime from the same layout.
+static void fixture_stat(const char* path, unsigned pid, const char* comm,
+    unsigned utime, unsigned stime, unsigned threads)
+{
+    write_file(path, "%u (%s) S 1 %u %u 0 -1 4194560 100 0 0 0 %u %u 0 0 20 0 %u 0 0 1000000 %u"
+        " 18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 0 0 0 %u 0 0\n",
+        pid, comm, pid, pid, utime, stime, threads, fixture_rss(pid), pid % 3);
+}
+
+// Busy pids and their threads advance every tick. Kept out of fixture_tick():
+// rewriting them would count against the walks timed there.
+static void fixture_busy_tick(unsigned tick)
+{
+    char path[64], comm[32];
+    for (unsigned pid = fixture_first_pid; fixture_busy(pid); pid++) {
+        snprintf(path, sizeof(path), "proc/%u", pid);
+        if (!g_file_test(path, G_FILE_TEST_IS_DIR))
+            break;
+        snprintf(path, sizeof(path), "proc/%u/stat", pid);
+        snprintf(comm, sizeof(comm), "bench-%u", pid);
+        fixture_stat(path, pid, comm, pid % 97 + tick * 200, pid % 13 + tick * 20, FIXTURE_BUSY_THREADS);
+        for (unsigned k = 0; k < FIXTURE_BUSY_THREADS; k++) {
+            unsigned tid = k ? pid * FIXTURE_BUSY_THREADS + k : pid;
+            snprintf(path, sizeof(path), "proc/%u/task/%u", pid, tid);
+            mkdir(path, 0755);
+            snprintf(path, sizeof(path), "proc/%u/task/%u/stat", pid, tid);
+            snprintf(comm, sizeof(comm), "worker-%u", k);
+            fixture_stat(path, tid, comm, tick * (k % 8), tick * (k % 2), FIXTURE_BUSY_THREADS);
+        }
+    }
+}
+
+static void fixture_pid(unsigned pid)
+{
+    char path[64], link[64], target[32], comm[32];
+    snprintf(path, sizeof(path), "proc/%u", pid);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "proc/%u/stat", pid);
+    snprintf(comm, sizeof(comm), "bench-%u", pid);
+    fixture_stat(path, pid, comm, pid % 97, pid % 13, 1 + pid % 8);
+    if (fixture_busy(pid)) {
+        snprintf(path, sizeof(path), "proc/%u/task", pid);
+        mkdir(path, 0755);
+    }
+
+    // The fields ProcessInfo_scan_smaps() reads, among the others
+    const unsigned rss_kb = fixture_rss(pid) * (sysconf(_SC_PAGESIZE) / 1024);
+    snprintf(path, sizeof(path), "proc/%u/smaps_rollup", pid);
+    write_file(path, "00400000-7ffc00000000 ---p 00000000 00:00 0                          [rollup]\n"
+        "Rss:            %8u kB\nPss:            %8u kB\nPss_Anon:       %8u kB\n"
+        "Pss_File:       %8u kB\nPss_Shmem:             0 kB\nShared_Clean:   %8u kB\n"
+        "Shared_Dirty:          0 kB\nPrivate_Clean:  %8u kB\nPrivate_Dirty:  %8u kB\n"
+        "Referenced:     %8u kB\nAnonymous:      %8u kB\nLazyFree:              0 kB\n"
+        "AnonHugePages:         0 kB\nShmemPmdMapped:        0 kB\nFilePmdMapped:         0 kB\n"
+        "Shared_Hugetlb:        0 kB\nPrivate_Hugetlb:       0 kB\nSwap:           %8u kB\n"
+        "SwapPss:        %8u kB\nLocked:                0 kB\n",
+        rss_kb, rss_kb * 3/4, rss_kb / 2, rss_kb / 4, rss_kb / 2, rss_kb / 8, rss_kb * 3/8,
+        rss_kb, rss_kb / 2, pid % 7 * 64, pid % 7 * 64);
+    // Some pids opt out of OOM kills, the others lean towards them
+    snprintf(path, sizeof(path), "proc/%u/oom_score_adj", pid);
+    write_file(path, "%d\n", pid % 11 ? (int)(pid % 5) * 100 : -1000);
+
+    snprintf(path, sizeof(path), "proc/%u/fd", pid);
+    mkdir(path, 0755);
+    for (int fd = 0; fd < fds_per_proc; fd++) {
+        snprintf(link, sizeof(link), "proc/%u/fd/%d", pid, fd);
+        if (fd < socks_per_proc)
+            snprintf(target, sizeof(target), "socket:[%u]", pid * socks_per_proc + fd + 1);
+        else
+            strcpy(target, "/dev/null");
+        if (symlink(target, link))
+            g_error("Cannot create %s: %s", link, g_strerror(errno));
+    }
+}
+
+// /proc lists pids in ascending order and top_procs_refresh() relies on it.
+// Filesystems differ (tmpfs lists newest first, ext4 in hash order), so probe
+// which creation order reads back ascending.
+static gboolean fixture_newest_first(void)
+{
+    mkdir("probe", 0755);
+    mkdir("probe/1", 0755);
+    mkdir("probe/2", 0755);
+    GDir* dir = g_dir_open("probe", 0, NULL);
+    const gchar* first = g_dir_read_name(dir);
+    gboolean newest_first = first && g_str_equal(first, "2");
+    g_dir_close(dir);
+    rmdir("probe/1");
+    rmdir("probe/2");
+    rmdir("probe");
+    return newest_first;
+}
+
+static void fixture_build(int n)
+{
+    gint64 t0 = prof_now_ns();
+    g_mkdir_with_parents("proc/net", 0755);
+    g_mkdir_with_parents("sys/devices/system/cpu/cpu0/cpufreq", 0755);
+    write_file("proc/meminfo", "MemTotal: 16384000 kB\nMemFree: 4096000 kB\nMemAvailable: 8192000 kB\n");
+    write_file("sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq", "1800000\n");
+    write_file("sys/devices/system/cpu/cpu0/cpufreq/scaling_min_freq", "800000\n");
+    write_file("sys/devices/system/cpu/cpu0/cpufreq/scaling_max_freq", "3600000\n");
+    fixture_tick(0);
+
+    gboolean descending = fixture_newest_first();
+    for (int i = 0; i < n; i++)
+        fixture_pid(fixture_first_pid + (descending ? n-1-i : i));
+    fixture_busy_tick(0);
+
+    GDir* dir = g_dir_open("proc", 0, NULL);
+    unsigned last = 0;
+    gboolean sorted = TRUE;
+    for (const gchar* name; (name = g_dir_read_name(dir)); )
+        if (name[0] >= '0' && name[0] <= '9') {
+            sorted &= (unsigned)atoi(name) > last;
+            last = atoi(name);
+        }
+    g_dir_close(dir);
+    if (!sorted)
+        g_printerr("Warning: fixture pids do not read back in order, top_procs_refresh figures include list churn\n");
+    printf("%d pids, %d fds (%d sockets) each, %d interfaces: fixture built in %.2f s\n",
+        n, fds_per_proc, socks_per_proc, fixture_ifaces, (prof_now_ns() - t0) / 1e9);
+}
+
+static void report(const char* what, gint64 ns, unsigned long allocs, int procs, int reps)
+{
+    printf("  %-26s %12.0f ns/tick", what, (double)ns / reps);
+    if (procs)
+        printf(" %8.0f ns/proc", (double)ns / reps / procs);
+    else
+        printf(" %16s", "");
+    printf(" %10.1f allocs/tick\n", (double)allocs / reps);
+}
+
+#define BENCH(what, procs, body) do { \
+    gint64 t0 = prof_now_ns(); \
+    unsigned long a0 = bench_allocs; \
+    for (int rep = 0; rep < ticks; rep++) { body; } \
+    report(what, prof_now_ns() - t0, bench_allocs - a0, procs, ticks); \
+} while (0)
+
+static void bench_run(int n)
+{
+    gchar** pids = g_new(gchar*, n);
+    for (int i = 0; i < n; i++)
+        pids[i] = g_strdup_printf("%u", fixture_first_pid + i);
+
+    pref_init();
+    history = g_malloc(sizeof(*history));
+    hist_size = width = 1;
+    update_history();
+
+    BENCH("ProcessInfo_scan", n,
+        for (int i = 0; i < n; i++) ProcessInfo_scan(pids[i]));
+
+    // Every call is a top tick; light ticks first, then full heavy passes
+    top_refresh_ms = refresh_interval_ms;
+    heavy_refresh_ms = G_MAXINT / 2;
+    top_procs_refresh(refresh_interval_ms); // Populate the process list
+    unsigned tick = 1;
+    BENCH("top_procs_refresh (light)", n, {
+        fixture_tick(tick++);
+        cpu_usage(SCALE);
+        top_procs_refresh(refresh_interval_ms);
+    });
+    heavy_refresh_ms = refresh_interval_ms;
+    heavy_slice_pids = G_MAXINT;
+    BENCH("top_procs_refresh (heavy)", n, {
+        fixture_tick(tick++);
+        cpu_usage(SCALE);
+        top_procs_refresh(refresh_interval_ms);
+    });
+
+    BENCH("ProcessInfo_scan_smaps", n,
+        for (ProcessInfo* p = top_procs; p; p = p->next) ProcessInfo_scan_smaps(p));
+
+    // Only threads_refresh() is timed: the walk before it picks the busy pids
+    gint64 threads_ns = 0;
+    unsigned long threads_allocs = 0;
+    for (int rep = 0; rep < ticks; rep++) {
+        fixture_tick(tick);
+        fixture_busy_tick(tick++);
+        cpu_usage(SCALE);
+        top_procs_refresh(refresh_interval_ms);
+        gint64 t0 = prof_now_ns();
+        unsigned long a0 = bench_allocs;
+        threads_refresh();
+        threads_ns += prof_now_ns() - t0;
+        threads_allocs += bench_allocs - a0;
+    }
+    report("threads_refresh", threads_ns, threads_allocs, MIN(n, THREAD_SAMPLE_PROCS), ticks);
+
+    BENCH("oom_pick_victim", n, oom_pick_victim());
+
+    BENCH("net_collect_pid_sockets", n, {
+        net_inode_map_clear();
+        for (int i = 0; i < n; i++) {
+            int socks;
+            net_collect_pid_sockets(pids[i], fixture_first_pid + i, &socks);
+        }
+    });
+
+    // Stand in for the inet_diag dump with one socket per collected inode
+    sock_hash_clear();
+    n_socks = 0;
+    for (int i = 0; i < n_inode_map && n_socks < MAX_SOCKETS; i++) {
+        SockStat* ss = &sock_stats[n_socks];
+        ss->inode = inode_map[i].inode;
+        ss->rtt_us = 1000 + i;
+        ss->bytes_acked = ss->bytes_received = 0;
+        sock_hash_insert(ss->inode, n_socks++);
+    }
+    BENCH("net_stats_aggregate", MIN(n, n_socks), {
+        sock_stats_time_us = prof_now_ns() / 1000;
+        for (int i = 0; i < n_socks; i++) {
+            sock_stats[i].bytes_acked += 4096;
+            sock_stats[i].bytes_received += 65536;
+        }
+        net_stats_aggregate();
+    });
+
+    static const int sizes[] = { 22, 48, 64 };
+    for (int i = 0; i < G_N_ELEMENTS(sizes); i++) {
+        char what[32];
+        snprintf(what, sizeof(what), "redraw %dx%d", sizes[i], sizes[i]);
+        resize_cb(NULL, sizes[i], NULL);
+        BENCH(what, 0, {
+            icon_damaged = TRUE;
+            redraw();
+        });
+    }
+}
+
+static int remove_cb(const char* path, const struct stat* st, int flag, struct FTW* ftw)
+{
+    return remove(path);
+}
+
+// Idle samples must stretch the interval from any basic one up to the ceiling
+static void bench_check_sched(void)
+{
+    const int saved_ms = refresh_interval_ms, basic_ms[] = { 250, 1000, 1500, 3000 };
+    SchedSample idle = {0};
+    for (int i = 0; i < G_N_ELEMENTS(basic_ms); i++) {
+        refresh_interval_ms = basic_ms[i];
+        sched_interval_ms = 0;
+        int ms = 0, n = 0, ceiling_ms = MAX(pref_max_refresh_ms, basic_ms[i]);
+        while (ms < ceiling_ms && n++ < 32)
+            ms = sched_next_interval(idle);
+        printf("Idle backoff from %d ms: %d ms after %d ticks\n", basic_ms[i], ms, n);
+        if (ms != ceiling_ms)
+            g_error("Idle backoff from %d ms stuck at %d ms, below %d ms", basic_ms[i], ms, ceiling_ms);
+    }
+    refresh_interval_ms = saved_ms;
+    sched_interval_ms = 0;
+}
+
+int main(int argc, char** argv)
+{
+    int scales[16] = { 1000, 10000, 100000 }, n_scales = 3, custom = 0;
+    for (int i = 1; i < argc; i++) {
+        int* opt = g_str_equal(argv[i], "-f") ? &fds_per_proc
+            : g_str_equal(argv[i], "-s") ? &socks_per_proc
+            : g_str_equal(argv[i], "-i") ? &fixture_ifaces
+            : g_str_equal(argv[i], "-t") ? &ticks : NULL;
+        if (opt && i+1 < argc)
+            *opt = atoi(argv[++i]);
+        else if (!opt && atoi(argv[i]) > 0 && custom < G_N_ELEMENTS(scales))
+            scales[custom++] = atoi(argv[i]);
+        else {
+            g_printerr("Usage: %s [-f fds] [-s sockets] [-i ifaces] [-t ticks] [pids...]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (custom)
+        n_scales = custom;
+    socks_per_proc = MIN(socks_per_proc, fds_per_proc);
+    ticks = MAX(ticks, 1);
+    bench_check_sched();
+
+    const char* base = g_file_test("/dev/shm", G_FILE_TEST_IS_DIR) ? "/dev/shm" : g_get_tmp_dir();
+    for (int s = 0; s < n_scales; s++) {
+        gchar* dir = g_build_filename(base, "gatotray-bench-XXXXXX", NULL);
+        if (!g_mkdtemp(dir))
+            g_error("Cannot create %s: %s", dir, g_strerror(errno));
+        fflush(stdout);
+        // Collectors keep files and the /proc GDir open in statics, so every
+        // scale gets a fresh process
+        pid_t child = fork();
+        if (!child) {
+            if (chdir(dir))
+                g_error("Cannot enter %s: %s", dir, g_strerror(errno));
+            fixture_build(scales[s]);
+            if (!root_set("."))
+                _exit(1);
+            bench_run(scales[s]);
+            fflush(stdout);
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        nftw(dir, remove_cb, 64, FTW_DEPTH | FTW_PHYS);
+        g_free(dir);
+        if (!WIFEXITED(status) || WEXITSTATUS(status))
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Example consumer of gatotray's shared memory snapshot (see gatotray-shm.h).
+ *
+ *   make gatotray-shm-reader
+ *   ./gatotray-shm-reader          # print the latest sample once
+ *   ./gatotray-shm-reader 1        # and then every second
+ *
+ * Mapping is the only syscall work; every read afterwards is a plain copy.
+ */
+#define _XOPEN_SOURCE 700
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gatotray-shm.h"
+
+static const char* top_names[GATOTRAY_TOP_COUNT] = {
+    "cpu", "avg cpu", "cpu time", "io wait", "memory", "network", "sockets", "fds", "threads",
+};
+
+static void print_sample(const GatotrayShm* s)
+{
+    printf("#%u  cpu %.1f%%  iowait %.1f%%  steal %.1f%%  %d MHz  %d°C  mem %d/%d MB  net %d/%d KB/s",
+        s->generation, s->cpu_usage * 100.0 / GATOTRAY_SHM_SCALE, s->cpu_iowait * 100.0 / GATOTRAY_SHM_SCALE,
+        s->cpu_steal * 100.0 / GATOTRAY_SHM_SCALE,
+        s->freq_mhz, s->temp_c, s->mem_avail_mb, s->mem_total_mb, s->net_rx_kbps, s->net_tx_kbps);
+    if (s->procs >= 0)
+        printf("  procs %d (%d active)", s->procs, s->procs_active);
+    putchar('\n');
+    for (int c = 0; c < GATOTRAY_TOP_COUNT; c++) {
+        if (s->top[c] < 0)
+            continue;
+        const GatotrayShmProc* p = &s->top_procs[s->top[c]];
+        printf("  top %-9s %-16s pid %-7u cpu %5.1f%%  rss %6llu MB  pss %6llu MB  fds %u  threads %u\n",
+            top_names[c], p->comm, p->pid, p->cpu_pct,
+            (unsigned long long)p->rss_bytes >> 20, (unsigned long long)p->pss_bytes >> 20, p->fds, p->threads);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int interval = argc > 1 ? atoi(argv[1]) : 0;
+    char name[32];
+    snprintf(name, sizeof(name), GATOTRAY_SHM_NAME_FORMAT, (unsigned)getuid());
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        perror(name);
+        return 1;
+    }
+    // Anybody can create names in /dev/shm: only trust one of ours that
+    // nobody else can write
+    struct stat st;
+    if (fstat(fd, &st) || st.st_uid != getuid() || (st.st_mode & 077)) {
+        fprintf(stderr, "%s: not private to this user, ignoring it\n", name);
+        return 1;
+    }
+    // Smaller while the publisher is starting (or from another version):
+    // reading past the end of the object would be SIGBUS
+    if (st.st_size < sizeof(GatotrayShm)) {
+        fprintf(stderr, "%s: not a gatotray v%d snapshot (yet)\n", name, GATOTRAY_SHM_VERSION);
+        return 1;
+    }
+    const GatotrayShm* shm = mmap(NULL, sizeof(GatotrayShm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    GatotrayShm sample;
+    uint32_t last = 0;
+    do {
+        if (!gatotray_shm_read(shm, &sample)) {
+            fprintf(stderr, "%s: not a gatotray v%d snapshot (yet)\n", name, GATOTRAY_SHM_VERSION);
+            return 1;
+        }
+        if (sample.generation != last)
+            print_sample(&sample);
+        last = sample.generation;
+    } while (interval > 0 && !sleep(interval));
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * gatotray shared memory snapshot: layout for local consumers.
+ *
+ * While running as a tray icon or with --stream, gatotray publishes its
+ * latest sample in the POSIX shared memory object "/gatotray-<uid>"
+ * (/dev/shm/gatotray-<uid> on Linux). Consumers map it read-only and copy it
+ * out with gatotray_shm_read(), which makes no syscalls: status bars,
+ * watchdogs and the like get the same numbers without parsing /proc again.
+ *
+ * The segment is guarded by a seqlock: the publisher makes seq odd, updates
+ * everything after the header, then makes it even again. A reader copies the
+ * segment between two even, equal reads of seq, retrying otherwise.
+ *
+ * The publisher holds flock(LOCK_EX) on the segment for as long as it runs.
+ * Further gatotray instances (e.g. the screensaver next to the tray icon)
+ * find it locked and render from the segment instead of collecting; the
+ * first one to get the lock after the publisher exits takes over.
+ *
+ * The layout only changes together with GATOTRAY_SHM_VERSION. Fields are
+ * little endian host order, ratios are fixed-point with 1.0 being
+ * GATOTRAY_SHM_SCALE. time_ms stops advancing when the publisher exits.
+ *
+ * The object is mode 0600. Anybody can create names in /dev/shm, so
+ * consumers should fstat() it and only map it when it belongs to them and
+ * grants nothing to group or others.
+ *
+ * See gatotray-shm-reader.c for a complete example.
+ */
+#ifndef GATOTRAY_SHM_H
+#define GATOTRAY_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define GATOTRAY_SHM_NAME_FORMAT "/gatotray-%u" /* getuid() */
+#define GATOTRAY_SHM_MAGIC   0x48535447u /* "GTSH" */
+#define GATOTRAY_SHM_VERSION 5
+#define GATOTRAY_SHM_SCALE   32768
+#define GATOTRAY_SHM_PROCS   16
+#define GATOTRAY_SHM_HISTORY 1024
+
+/* Categories of gatotray's "top" processes, as in its tooltip */
+enum {
+    GATOTRAY_TOP_CPU,        /* Current CPU use */
+    GATOTRAY_TOP_AVG_CPU,    /* Average CPU use since start */
+    GATOTRAY_TOP_CUMULATIVE, /* Total CPU time */
+    GATOTRAY_TOP_IO,         /* I/O wait */
+    GATOTRAY_TOP_MEM,        /* PSS, else resident memory */
+    GATOTRAY_TOP_NET,        /* TCP bandwidth */
+    GATOTRAY_TOP_SOCKETS,
+    GATOTRAY_TOP_FDS,
+    GATOTRAY_TOP_THREADS,
+    GATOTRAY_TOP_COUNT
+};
+
+typedef struct {
+    uint32_t pid;
+    uint32_t threads, fds, sockets;
+    uint64_t rss_bytes;
+    uint64_t pss_bytes, uss_bytes, swap_bytes; /* From smaps_rollup; pss 0 when unreadable, then ranked by rss */
+    float cpu_pct, avg_cpu_pct, iowait_pct; /* Percent of one core */
+    int32_t net_rx_kbps, net_tx_kbps;
+    uint32_t min_rtt_us;                    /* 0 when unknown */
+    char comm[32];                          /* NUL terminated */
+} GatotrayShmProc;
+
+/* One column of the publisher's graph. Older columns are blended averages,
+ * see timeout_cb() in gatotray.c. */
+typedef struct {
+    int32_t cpu_usage, cpu_iowait;
+    int32_t cpu_irq, cpu_softirq, cpu_steal, cpu_guest;
+    int32_t freq;          /* Position between min and max frequency */
+    int32_t temp_c;
+    int32_t mem_avail;     /* Available fraction of total memory */
+    int32_t net_rx_kbps, net_tx_kbps;
+    int32_t ctxt_per_s, intr_per_s, forks_per_s; /* System-wide */
+    int32_t procs_running, procs_blocked;       /* Task counts */
+} GatotrayShmColumn;
+
+typedef struct {
+    /* Header: written once, before any sample */
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;          /* sizeof(GatotrayShm) */
+    uint32_t seq;           /* Seqlock sequence, odd while being written */
+
+    /* Latest sample */
+    uint32_t generation;    /* Increments with every sample */
+    uint32_t pid;           /* Of the publisher */
+    int64_t time_ms;        /* Wall clock time of the sample */
+    int32_t cpu_usage;      /* Busy fraction, iowait excluded (see cpu_iowait) */
+    int32_t cpu_iowait;     /* Idle waiting for I/O, not in cpu_usage */
+    int32_t cpu_irq, cpu_softirq; /* Included in cpu_usage */
+    int32_t cpu_guest;      /* Included in cpu_usage: running virtual machines */
+    int32_t cpu_steal;      /* Taken by the hypervisor, not in cpu_usage */
+    int32_t freq_mhz;       /* 0 when unknown */
+    int32_t temp_c;         /* 0 when unknown */
+    int32_t mem_total_mb, mem_avail_mb;
+    int32_t net_rx_kbps, net_tx_kbps;
+    int32_t procs, procs_active; /* -1 when the publisher does not walk /proc */
+
+    /* Top processes: each category's index into top_procs[], or -1 */
+    uint32_t n_top_procs;
+    int8_t top[GATOTRAY_TOP_COUNT];
+    int8_t reserved[20 - GATOTRAY_TOP_COUNT]; /* Keeps top_procs[] 8-byte aligned */
+    GatotrayShmProc top_procs[GATOTRAY_SHM_PROCS];
+
+    /* Graph history, newest first. Read it with gatotray_shm_read_history() */
+    uint32_t hist_len;
+    uint32_t hist_reserved;
+    GatotrayShmColumn history[GATOTRAY_SHM_HISTORY];
+} GatotrayShm;
+
+/* Copies a consistent sample (everything up to hist_len) out of the mapped
+ * segment. Returns 0 when the segment is not (yet) a gatotray snapshot of
+ * this version, or when the publisher kept it busy for too long. */
+static inline int gatotray_shm_read(const GatotrayShm* shm, GatotrayShm* out)
+{
+    for (int tries = 0; tries < 1000; tries++) {
+        uint32_t seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+        memcpy(out, shm, offsetof(GatotrayShm, hist_len));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq)
+            return out->magic == GATOTRAY_SHM_MAGIC && out->version == GATOTRAY_SHM_VERSION
+                && out->size == sizeof(*out);
+    }
+    return 0;
+}
+
+/* Copies up to max columns of history, newest first. Returns how many. */
+static inline uint32_t gatotray_shm_read_history(const GatotrayShm* shm, GatotrayShmColumn* out, uint32_t max)
+{
+    for (int tries = 0; tries < 1000; tries++) {
+        uint32_t seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+        uint32_t n = __atomic_load_n(&shm->hist_len, __ATOMIC_RELAXED);
+        n = n < max ? n : max;
+        n = n < GATOTRAY_SHM_HISTORY ? n : GATOTRAY_SHM_HISTORY;
+        memcpy(out, shm->history, n * sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq)
+            return n;
+    }
+    return 0;
+}
+
+#endif /* GATOTRAY_SHM_H */
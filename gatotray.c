@@ -25,13 +25,10 @@
  * TODO:
  * - Add "About" dialog with link to website.
  * - Refactor into headers+bodies.
- * - Refactor drawing code to reduce the chain pixmap-->pixbuf-->icon, specialy
- *   when transparency is enabled ... Check gdk_pixbuf_new_from_data() and
- *   gdk_pixbuf_from_pixdata().
  *
  */
 
-#define _XOPEN_SOURCE 500
+#define _XOPEN_SOURCE 700
 #include <sys/types.h>
 #include <signal.h>
 #include <string.h>
@@ -54,10 +51,16 @@
 #define IO_WAIT_THRESHOLD 1    // I/O wait % below which to show minimal-wait icon (🔄)
 
 // TODO: Include headers instead of full modules
+#include "sysroot.c"
+#include "profile.c"
+#include "runtime.c"
 #include "cpu_usage.c"
 #include "net_stats.c"
+#include "metrics_log.c"
 #include "settings.c"
+#include "sched.c"
 #include "top_procs.c"
+#include "threads.c"
 #include "gatotray.xpm"
 
 typedef struct {
@@ -67,6 +70,7 @@ typedef struct {
     int free_memory;
     int net_rx_KBps;
     int net_tx_KBps;
+    SchedStats sched;
 } CPUstatus;
 
 CPUstatus* history = NULL;
@@ -74,15 +78,36 @@ CPUstatus* history = NULL;
 int width = 0, hist_size = 0, timer = 0;
 time_t start_time = 0;
 
-GdkPixmap *pixmap = NULL;
+GdkPixbuf *icon_pixbuf = NULL; // Client-side RGBA frame, reused every tick
 GtkStatusIcon *app_icon = NULL;
 GdkWindow *screensaver = NULL;
-GString* info_text = NULL;
 gchar* abs_argv0;
 
+// Latest collected sample. Collection fills it every tick; text is formatted
+// from it only when someone looks (tooltip, clipboard, screensaver, --info).
+typedef struct {
+    unsigned generation;
+    time_t time;
+    CPU_Usage cpu;
+    int freq_MHz, temp;
+    MemInfo mem;
+    int net_rx_KBps, net_tx_KBps;
+    SchedStats sched;
+} Snapshot;
+Snapshot snapshot = {0};
+gboolean snapshot_procs = TRUE; // FALSE skips the per-process walk (see stream.c)
+GString* info_text = NULL; // Formatted snapshot, valid while info_text_generation matches
+unsigned info_text_generation = 0;
+
+#include "shm.c"
+#include "alerts.c"
+#include "oom.c"
+#include "quantiles.c"
+
 // Forward declarations for history cache functions
 void history_save(void);
 void history_load(void);
+const char* info_text_get(void);
 
 static void
 popup_menu_cb(GtkStatusIcon *status_icon, guint button, guint time, GtkMenu* menu)
@@ -93,11 +118,9 @@ popup_menu_cb(GtkStatusIcon *status_icon, guint button, guint time, GtkMenu* men
 static void
 copy_current_info_to_clipboard(GtkMenuItem *menuitem G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
 {
-    if (info_text && info_text->len)
-        gtk_clipboard_set_text(gtk_clipboard_get(GDK_SELECTION_CLIPBOARD), info_text->str, -1);
+    gtk_clipboard_set_text(gtk_clipboard_get(GDK_SELECTION_CLIPBOARD), info_text_get(), -1);
 }
 
-GdkGC *gc = NULL;
 GdkPoint Termometer[] = {{2,16},{2,2},{3,1},{4,1},{5,2},{5,16},{6,17},{6,19},{5,20},
     {2,20},{1,19},{1,17},{2,16}};
 #define Termometer_tube_points 6 /* first points are the 'tube' */
@@ -107,15 +130,157 @@ GdkPoint Termometer[] = {{2,16},{2,2},{3,1},{4,1},{5,2},{5,16},{6,17},{6,19},{5,
 GdkPoint termometer_tube[Termometer_tube_points];
 GdkPoint termometer[G_N_ELEMENTS(Termometer)];
 
-void redraw(void)
+// Tray icon rasterizer: draws straight into icon_pixbuf's RGBA bytes, so a
+// frame needs no X server round trip and no per-tick allocation.
+static guchar* icon_pixels;
+static int icon_rowstride, icon_height;
+
+// Damage tracking: each frame is first quantized to the icon's pixel grid and
+// compared with the previous one, so unchanged frames skip drawing and upload.
+typedef struct {
+    gint16 mem, iow, steal, usage, irq, guest, net_tx, net_rx, shade;
+} IconColumn;
+typedef struct {
+    int termometer; // Temperature shade, or -1 when hidden (unavailable or blinking off)
+    gboolean alert_frame; // Blinking alert rule, see alerts.c
+    unsigned prefs_generation;
+} IconState;
+static IconColumn *icon_columns = NULL, *icon_columns_prev = NULL;
+static IconState icon_state, icon_state_prev;
+static gboolean icon_damaged = TRUE;
+unsigned icon_frames_drawn = 0, icon_frames_skipped = 0;
+
+// Packs a color as RGBA bytes. As gdk_pixbuf_add_alpha() used to do, the
+// background color becomes fully transparent when pref_transparent is set.
+static inline guint32 icon_ink(const GdkColor* c)
+{
+    guint8 rgba[4] = { c->red>>8, c->green>>8, c->blue>>8, 255 };
+    if (pref_transparent && rgba[0] == bg_color.red>>8
+            && rgba[1] == bg_color.green>>8 && rgba[2] == bg_color.blue>>8)
+        rgba[3] = 0;
+    guint32 px;
+    memcpy(&px, rgba, sizeof(px));
+    return px;
+}
+
+static inline void icon_plot(int x, int y, guint32 px)
+{
+    if (x >= 0 && x < width && y >= 0 && y < icon_height)
+        memcpy(icon_pixels + y*icon_rowstride + x*4, &px, 4);
+}
+
+// Vertical span [y0, y1) at column x, same as a GDK_CAP_NOT_LAST line
+static inline void icon_vline(int x, int y0, int y1, guint32 px)
+{
+    guchar* p = icon_pixels + MAX(y0, 0)*icon_rowstride + x*4;
+    for (int y = MAX(y0, 0); y < MIN(y1, icon_height); y++, p += icon_rowstride)
+        memcpy(p, &px, 4);
+}
+
+static inline int ceil_int(float v) { int i = v; return i + (v > i); }
+
+// Even-odd scanline fill sampling pixel centers, like gdk_draw_polygon()
+static void icon_fill_polygon(const GdkPoint* pts, int n, guint32 px)
+{
+    for (int y = 0; y < icon_height; y++) {
+        float cy = y + .5f, xs[G_N_ELEMENTS(Termometer)];
+        int nx = 0;
+        for (int i = 0; i < n; i++) {
+            const GdkPoint *a = &pts[i], *b = &pts[(i+1)%n];
+            if ((a->y <= cy) == (b->y <= cy))
+                continue;
+            float x = a->x + (cy - a->y) * (b->x - a->x) / (b->y - a->y);
+            int j = nx++;
+            for (; j > 0 && xs[j-1] > x; j--)
+                xs[j] = xs[j-1];
+            xs[j] = x;
+        }
+        for (int i = 0; i+1 < nx; i += 2)
+            for (int x = ceil_int(xs[i] - .5f); x < ceil_int(xs[i+1] - .5f); x++)
+                icon_plot(x, y, px);
+    }
+}
+
+static void icon_draw_lines(const GdkPoint* pts, int n, guint32 px)
+{
+    for (int i = 0; i+1 < n; i++) {
+        int x = pts[i].x, y = pts[i].y, x1 = pts[i+1].x, y1 = pts[i+1].y;
+        int dx = ABS(x1-x), dy = -ABS(y1-y), sx = x < x1 ? 1 : -1, sy = y < y1 ? 1 : -1;
+        for (int err = dx+dy;;) { // Bresenham
+            icon_plot(x, y, px);
+            if (x == x1 && y == y1) break;
+            int e2 = 2*err;
+            if (e2 >= dy) { err += dy; x += sx; }
+            if (e2 <= dx) { err += dx; y += sy; }
+        }
+    }
+}
+
+// Screensaver back buffer, text layout and memory gradient are kept across
+// frames and rebuilt only when the window size or preferences change.
+static cairo_surface_t* ss_buffer = NULL;
+static cairo_t* ss_cr = NULL;
+static PangoLayout* ss_layout = NULL;
+static cairo_pattern_t* ss_mem_pattern = NULL;
+static int ss_w = 0, ss_h = 0;
+static unsigned ss_prefs_generation = 0;
+static CPUstatus* ss_frame = NULL; // Interpolated history while animating, else NULL
+
+// Bands of the CPU graph above the iowait at its base, bottom and top per
+// column. Stacked like the tray icon: steal, then busy time with its irq and
+// guest parts at its base.
+typedef enum { BAND_STEAL, BAND_BUSY, BAND_IRQ, BAND_GUEST } CPUBand;
+
+static void cpu_band(const CPU_Usage* cpu, CPUBand band, int* lo, int* hi)
+{
+    int base = cpu->iowait + cpu->steal, irq = MIN(cpu->irq + cpu->softirq, cpu->usage);
+    switch (band) {
+    case BAND_STEAL: *lo = cpu->iowait; *hi = base; break;
+    case BAND_BUSY: *lo = base; *hi = base + cpu->usage; break;
+    case BAND_IRQ: *lo = base; *hi = base + irq; break;
+    case BAND_GUEST: *lo = base + irq; *hi = base + MIN(irq + cpu->guest, cpu->usage); break;
+    }
+}
+
+// Fills one band across the screensaver, skipped when empty all along
+static void ss_fill_band(cairo_t* cr, const CPUstatus* hist, CPUBand band,
+    const GdkColor* color, float d_w, float d_h, int h)
+{
+    int lo, hi, x;
+    for (x = 0; x < width; x++) {
+        cpu_band(&hist[x].cpu, band, &lo, &hi);
+        if (hi > lo)
+            break;
+    }
+    if (x == width)
+        return;
+    cairo_new_path(cr);
+    for (x = 0; x < width; x++) {
+        cpu_band(&hist[width-1-x].cpu, band, &lo, &hi);
+        cairo_line_to(cr, x*d_w, h - d_h * hi);
+    }
+    for (x = width-1; x >= 0; x--) {
+        cpu_band(&hist[width-1-x].cpu, band, &lo, &hi);
+        cairo_line_to(cr, x*d_w, h - d_h * lo);
+    }
+    cairo_close_path(cr);
+    const float _1 = 1.0/65535;
+    cairo_set_source_rgba(cr, _1*color->red, _1*color->green, _1*color->blue, 0.7);
+    cairo_fill(cr);
+}
+
+static void redraw_frame(void)
 {
     const int height = width;
 
+    // Screensaver animation frames render an interpolated copy of the history
+    const CPUstatus* hist = screensaver && ss_frame ? ss_frame : history;
+
     // Compute net bandwidth scale from history
     int net_max_KBps = 1;
     for (int i = 0; i < width; i++) {
-        if (history[i].net_rx_KBps > net_max_KBps) net_max_KBps = history[i].net_rx_KBps;
-        if (history[i].net_tx_KBps > net_max_KBps) net_max_KBps = history[i].net_tx_KBps;
+        if (hist[i].net_rx_KBps > net_max_KBps) net_max_KBps = hist[i].net_rx_KBps;
+        if (hist[i].net_tx_KBps > net_max_KBps) net_max_KBps = hist[i].net_tx_KBps;
     }
 
     if (screensaver)
@@ -123,47 +288,80 @@ void redraw(void)
         int w = gdk_window_get_width(screensaver), h = gdk_window_get_height(screensaver);
 
         cairo_t *screen = gdk_cairo_create(screensaver);
-        cairo_surface_t *double_buffer = cairo_surface_create_similar_image(
-            cairo_get_target(screen), CAIRO_FORMAT_RGB24, w, h);
-        cairo_t *cr = cairo_create (double_buffer);
-
-        if (bg_color.red || bg_color.green || bg_color.blue) {
-            gdk_cairo_set_source_color(cr, &bg_color);
-            cairo_paint(cr);
+        if (!ss_buffer || w != ss_w || h != ss_h) {
+            if (ss_layout) g_object_unref(ss_layout);
+            if (ss_cr) cairo_destroy(ss_cr);
+            if (ss_buffer) cairo_surface_destroy(ss_buffer);
+            ss_buffer = cairo_surface_create_similar_image(
+                cairo_get_target(screen), CAIRO_FORMAT_RGB24, w, h);
+            ss_cr = cairo_create(ss_buffer);
+            ss_layout = pango_cairo_create_layout(ss_cr);
+            pango_layout_set_width(ss_layout, w * PANGO_SCALE);
+            pango_layout_set_alignment(ss_layout, PANGO_ALIGN_CENTER);
+            ss_w = w;
+            ss_h = h;
+            ss_prefs_generation = prefs_generation - 1;
         }
+        cairo_t *cr = ss_cr;
 
         const float _1 = 1.0/65535;
         float d_w = w*1.0/width, d_h = h*1.0/SCALE;
+        float r = _1*mem_color.red, g = _1*mem_color.green, b = _1*mem_color.blue;
+
+        if (ss_prefs_generation != prefs_generation) {
+            if (ss_mem_pattern) cairo_pattern_destroy(ss_mem_pattern);
+            ss_mem_pattern = cairo_pattern_create_linear(0,0,0,h);
+            cairo_pattern_add_color_stop_rgba(ss_mem_pattern, 0, r,g,b, 0.0);
+            cairo_pattern_add_color_stop_rgba(ss_mem_pattern, 1, r,g,b, 0.7);
+            ss_prefs_generation = prefs_generation;
+        }
+
+        // The back buffer persists across frames, so always clear it
+        gdk_cairo_set_source_color(cr, &bg_color);
+        cairo_paint(cr);
 
         // Draw free memory filled path (hanging from top)
-        float r = _1*mem_color.red, g = _1*mem_color.green, b = _1*mem_color.blue;
         cairo_move_to(cr, 0, 0);
         for(int x=0; x<width; x++)
-            cairo_line_to(cr, x*d_w, d_h * history[width-1-x].free_memory);
+            cairo_line_to(cr, x*d_w, d_h * hist[width-1-x].free_memory);
         cairo_rel_line_to(cr, d_w-1, 0);
         cairo_line_to(cr, w-1, 0);
         cairo_close_path(cr);
         cairo_set_source_rgb(cr, r,g,b);
         cairo_stroke_preserve(cr);
-        cairo_pattern_t *pattern = cairo_pattern_create_linear(0,0,0,h);
-        cairo_pattern_add_color_stop_rgba(pattern, 0, r,g,b, 0.0);
-        cairo_pattern_add_color_stop_rgba(pattern, h, r,g,b, 0.7);
-        cairo_set_source(cr, pattern);
+        cairo_set_source(cr, ss_mem_pattern);
         cairo_fill(cr);
-        cairo_pattern_destroy(pattern);
 
-        // Draw CPU usage filled path, pattern-colored by frequency
-        cairo_move_to(cr, 0, h-1);
-        pattern = cairo_pattern_create_linear(0,0,w,0);
-        GdkColor* shade = {0};
+        // Draw CPU usage filled path, pattern-colored by frequency. Columns of
+        // equal shade share a run with stops at its first and last centers only,
+        // which renders the same as one stop per column.
+        cairo_new_path(cr);
+        cairo_pattern_t *pattern = cairo_pattern_create_linear(0,0,w,0);
+        GdkColor* shade = NULL;
+        int run_start = 0, lo, hi;
+        #define add_shade_stop(x) cairo_pattern_add_color_stop_rgba(pattern, ((x)+.5)/width \
+            , _1*shade->red, _1*shade->green, _1*shade->blue, 0.7)
         for(int x=0; x<width; x++) {
-            CPUstatus* st = &history[width-1-x];
-            cairo_line_to(cr, x*d_w, h - (d_h * st->cpu.usage));
-            shade = &freq_gradient[MIN(MAX(0, st->freq*MAX_SHADE/SCALE), MAX_SHADE)];
-            cairo_pattern_add_color_stop_rgba(pattern, (x+.5)/width, _1*shade->red, _1*shade->green, _1*shade->blue, 0.7);
+            const CPUstatus* st = &hist[width-1-x];
+            cpu_band(&st->cpu, BAND_BUSY, &lo, &hi);
+            cairo_line_to(cr, x*d_w, h - (d_h * hi));
+            GdkColor* c = &freq_gradient[MIN(MAX(0, st->freq*MAX_SHADE/SCALE), MAX_SHADE)];
+            if (c != shade) {
+                if (shade && run_start < x-1)
+                    add_shade_stop(x-1);
+                shade = c;
+                run_start = x;
+                add_shade_stop(x);
+            }
         }
+        if (run_start < width-1)
+            add_shade_stop(width-1);
+        #undef add_shade_stop
         cairo_rel_line_to(cr, d_w-1, 0);
-        cairo_line_to(cr, w-1, h-1);
+        for (int x = width-1; x >= 0; x--) { // Back along the steal and iowait below
+            cpu_band(&hist[width-1-x].cpu, BAND_BUSY, &lo, &hi);
+            cairo_line_to(cr, x == width-1 ? w-1 : x*d_w, MIN(h - d_h * lo, h-1));
+        }
         cairo_close_path(cr);
         cairo_set_source_rgb(cr, _1*shade->red, _1*shade->green, _1*shade->blue);
         cairo_stroke_preserve(cr);
@@ -171,10 +369,15 @@ void redraw(void)
         cairo_fill(cr);
         cairo_pattern_destroy(pattern);
 
-        // Draw I/O wait on top of usage
+        // IRQ and guest time inside busy time, steal between it and I/O wait
+        ss_fill_band(cr, hist, BAND_IRQ, &irq_color, d_w, d_h, h);
+        ss_fill_band(cr, hist, BAND_GUEST, &guest_color, d_w, d_h, h);
+        ss_fill_band(cr, hist, BAND_STEAL, &steal_color, d_w, d_h, h);
+
+        // Draw I/O wait at the base, under steal and usage
         cairo_move_to(cr, 0, h-1);
         for(int x=0; x<width; x++)
-            cairo_line_to(cr, x*d_w, h-(d_h * history[width-1-x].cpu.iowait));
+            cairo_line_to(cr, x*d_w, h-(d_h * hist[width-1-x].cpu.iowait));
         cairo_rel_line_to(cr, d_w-1, 0); // Move to last pixel on the right side
         cairo_line_to(cr, w-1, h-1);
         cairo_close_path(cr);
@@ -187,7 +390,7 @@ void redraw(void)
         float mid_y = h / 2.0, quarter_h = h / 4.0;
         cairo_move_to(cr, 0, mid_y);
         for (int x = 0; x < width; x++) {
-            float bar = history[width-1-x].net_tx_KBps * quarter_h / net_max_KBps;
+            float bar = hist[width-1-x].net_tx_KBps * quarter_h / net_max_KBps;
             if (bar > quarter_h) bar = quarter_h;
             cairo_line_to(cr, x * d_w, mid_y - bar);
         }
@@ -199,7 +402,7 @@ void redraw(void)
 
         cairo_move_to(cr, 0, mid_y);
         for (int x = 0; x < width; x++) {
-            float bar = history[width-1-x].net_rx_KBps * quarter_h / net_max_KBps;
+            float bar = hist[width-1-x].net_rx_KBps * quarter_h / net_max_KBps;
             if (bar > quarter_h) bar = quarter_h;
             cairo_line_to(cr, x * d_w, mid_y + bar);
         }
@@ -209,104 +412,125 @@ void redraw(void)
         cairo_set_source_rgba(cr, _1*net_rx_color.red, _1*net_rx_color.green, _1*net_rx_color.blue, 0.5);
         cairo_fill(cr);
 
-        PangoContext *pango = pango_cairo_create_context(cr);
-        PangoLayout *pl = pango_layout_new (pango);
-        pango_layout_set_width (pl, w * PANGO_SCALE);
-        pango_layout_set_alignment (pl, PANGO_ALIGN_CENTER);
-        pango_layout_set_text (pl, info_text ? info_text->str : GATOTRAY_VERSION, -1);
+        const char* text = info_text_get();
+        if (g_strcmp0(pango_layout_get_text(ss_layout), text))
+            pango_layout_set_text(ss_layout, text, -1);
         gdk_cairo_set_source_color(cr, &fg_color);
-        pango_cairo_show_layout(cr, pl);
-        g_object_unref(pl);
-        g_object_unref(pango);
+        pango_cairo_show_layout(cr, ss_layout);
 
-        cairo_destroy(cr); // Draw now, then destroy all associated resouces (e.g. patterns)
-        cairo_set_source_surface(screen, double_buffer, 0, 0);
+        cairo_surface_flush(ss_buffer);
+        cairo_set_source_surface(screen, ss_buffer, 0, 0);
         cairo_paint(screen);
         cairo_destroy(screen);
-        cairo_surface_destroy(double_buffer);
     }
     else
     {
-        gdk_gc_set_rgb_fg_color(gc, &bg_color);
-        gdk_draw_rectangle(pixmap, gc, TRUE, 0, 0, width, height);
-
+        const int mid = height / 2, quarter = height / 4;
         for(int x=0; x<width; x++)
         {
             CPUstatus* h = &history[width-1-x];
-
-            if (x&1) {
-                gdk_gc_set_rgb_fg_color(gc, &mem_color);
-                gdk_draw_line(pixmap, gc, x, 0, x, RESCALE(h->free_memory,height));
-            }
-
-            GdkColor* shade = &freq_gradient[MIN(MAX(0, h->freq*MAX_SHADE/SCALE), MAX_SHADE)];
-            // Or shade by temperature: &temp_gradient[MIN(MAX(0, h->temp*MAX_SHADE/SCALE, SCALE)];
-
-            /* Bottom blue strip for i/o waiting cycles: */
-            int iow_size = RESCALE(h->cpu.iowait,height);
-            int bottom = height-iow_size;
-            if( iow_size ) {
-                gdk_gc_set_rgb_fg_color(gc, &iow_color);
-                gdk_draw_line(pixmap, gc, x, bottom, x, height);
-            }
-
-            gdk_gc_set_rgb_fg_color(gc, shade);
-            gdk_draw_line(pixmap, gc, x, bottom-RESCALE(h->cpu.usage,height), x, bottom);
-
+            IconColumn* c = &icon_columns[x];
+            c->mem = x&1 ? RESCALE(h->free_memory,height) : 0;
+            c->iow = RESCALE(h->cpu.iowait,height);
+            c->steal = RESCALE(h->cpu.steal,height);
+            c->usage = RESCALE(h->cpu.usage,height);
+            c->irq = MIN(RESCALE(h->cpu.irq + h->cpu.softirq,height), c->usage);
+            c->guest = MIN(RESCALE(h->cpu.guest,height), c->usage - c->irq);
+            c->shade = MIN(MAX(0, h->freq*MAX_SHADE/SCALE), MAX_SHADE);
+            // Or shade by temperature: MIN(MAX(0, h->temp*MAX_SHADE/SCALE, SCALE)
             // Network bandwidth lines at every other pixel (opposite to memory)
-            if (!(x&1)) {
-                int mid = height / 2;
-                int quarter = height / 4;
-                if (h->net_tx_KBps) {
-                    int bar = h->net_tx_KBps * quarter / net_max_KBps;
-                    if (bar > quarter) bar = quarter;
-                    if (bar > 0) {
-                        gdk_gc_set_rgb_fg_color(gc, &net_tx_color);
-                        gdk_draw_line(pixmap, gc, x, mid - bar, x, mid);
-                    }
-                }
-                if (h->net_rx_KBps) {
-                    int bar = h->net_rx_KBps * quarter / net_max_KBps;
-                    if (bar > quarter) bar = quarter;
-                    if (bar > 0) {
-                        gdk_gc_set_rgb_fg_color(gc, &net_rx_color);
-                        gdk_draw_line(pixmap, gc, x, mid, x, mid + bar);
-                    }
-                }
-            }
+            c->net_tx = x&1 ? 0 : MIN(h->net_tx_KBps * quarter / net_max_KBps, quarter);
+            c->net_rx = x&1 ? 0 : MIN(h->net_rx_KBps * quarter / net_max_KBps, quarter);
         }
 
         int T;
+        icon_state.termometer = -1;
         if (pref_thermometer && (T=history[0].temp)) /* if temp=0, it could not be read */
         if ( T<pref_temp_alarm || (timer&1) ) /* Blink when hot! */
-        {
             /* scale temp from 5~105 degrees Celsius to 0~GRADIENT_SIZE*/
-            T = MIN(MAX(0, (T-5)*MAX_SHADE/100), MAX_SHADE);
-            gdk_gc_set_rgb_fg_color(gc, &temp_gradient[T]);
-            gdk_draw_polygon(pixmap, gc, TRUE, termometer, G_N_ELEMENTS(termometer));
+            icon_state.termometer = MIN(MAX(0, (T-5)*MAX_SHADE/100), MAX_SHADE);
+        icon_state.alert_frame = (timer&1) && alerts_blinking();
+        icon_state.prefs_generation = prefs_generation;
+
+        if (!icon_damaged && !memcmp(&icon_state, &icon_state_prev, sizeof(icon_state))
+                && !memcmp(icon_columns, icon_columns_prev, width*sizeof(*icon_columns))) {
+            icon_frames_skipped++;
+            return;
+        }
+
+        const guint32 bg = icon_ink(&bg_color), mem = icon_ink(&mem_color), iow = icon_ink(&iow_color)
+            , steal = icon_ink(&steal_color), irq = icon_ink(&irq_color), guest = icon_ink(&guest_color)
+            , net_tx = icon_ink(&net_tx_color), net_rx = icon_ink(&net_rx_color);
+        for (int y = 0; y < height; y++) {
+            guchar* row = icon_pixels + y*icon_rowstride;
+            for (int x = 0; x < width; x++)
+                memcpy(row + x*4, &bg, 4);
+        }
+
+        for(int x=0; x<width; x++)
+        {
+            IconColumn* c = &icon_columns[x];
+            if (c->mem)
+                icon_vline(x, 0, c->mem, mem);
+
+            /* Bottom blue strip for i/o waiting cycles, then steal, then busy
+             * time with its irq and guest parts at its base: */
+            int bottom = height-c->iow;
+            if (c->iow)
+                icon_vline(x, bottom, height, iow);
+            if (c->steal)
+                icon_vline(x, bottom-c->steal, bottom, steal);
+            bottom -= c->steal;
+
+            icon_vline(x, bottom-c->usage, bottom, icon_ink(&freq_gradient[c->shade]));
+            if (c->irq)
+                icon_vline(x, bottom-c->irq, bottom, irq);
+            if (c->guest)
+                icon_vline(x, bottom-c->irq-c->guest, bottom-c->irq, guest);
+
+            if (c->net_tx > 0)
+                icon_vline(x, mid - c->net_tx, mid, net_tx);
+            if (c->net_rx > 0)
+                icon_vline(x, mid, mid + c->net_rx, net_rx);
+        }
+
+        if ((T = icon_state.termometer) >= 0)
+        {
+            icon_fill_polygon(termometer, G_N_ELEMENTS(termometer), icon_ink(&temp_gradient[T]));
             if( T<MAX_SHADE )
             {
                 termometer_tube[0].y = (T*termometer[1].y+(MAX_SHADE-T)*termometer[0].y)/MAX_SHADE;
                 termometer_tube[Termometer_tube_points-1].y = termometer_tube[0].y;
-                gdk_gc_set_rgb_fg_color(gc, &bg_color);
-                gdk_draw_polygon(pixmap, gc, TRUE, termometer_tube, Termometer_tube_points);
+                icon_fill_polygon(termometer_tube, Termometer_tube_points, bg);
             }
-            gdk_gc_set_rgb_fg_color(gc, &fg_color);
-            gdk_draw_lines(pixmap, gc, termometer, G_N_ELEMENTS(termometer));
+            icon_draw_lines(termometer, G_N_ELEMENTS(termometer), icon_ink(&fg_color));
         }
 
-        GdkPixbuf *pixbuf = gdk_pixbuf_get_from_drawable(NULL, pixmap, NULL, 0, 0, 0, 0, width, height);
-        if (pref_transparent) { // TODO: Draw directly with alpha!
-            GdkPixbuf* new = gdk_pixbuf_add_alpha(pixbuf, TRUE
-                , bg_color.red>>8, bg_color.green>>8, bg_color.blue>>8);
-            g_object_unref(pixbuf);
-            pixbuf = new;
+        if (icon_state.alert_frame) {
+            const GdkPoint frame[] = {{0,0}, {width-1,0}, {width-1,height-1}, {0,height-1}, {0,0}};
+            icon_draw_lines(frame, G_N_ELEMENTS(frame), icon_ink(&temp_max_color));
         }
-        gtk_status_icon_set_from_pixbuf(GTK_STATUS_ICON(app_icon), pixbuf);
-        g_object_unref(pixbuf);
+
+        // Same pixbuf every frame: GtkStatusIcon takes a reference and repaints from it
+        if (app_icon) // NULL when benchmarking headless
+            gtk_status_icon_set_from_pixbuf(GTK_STATUS_ICON(app_icon), icon_pixbuf);
+        icon_frames_drawn++;
+
+        IconColumn* swap = icon_columns_prev;
+        icon_columns_prev = icon_columns;
+        icon_columns = swap;
+        icon_state_prev = icon_state;
+        icon_damaged = FALSE;
     }
 }
 
+void redraw(void)
+{
+    gint64 t0 = prof_now_ns();
+    redraw_frame();
+    prof_end(PS_REDRAW, t0);
+}
+
 gboolean
 resize_cb(GtkStatusIcon *app_icon, gint newsize, gpointer user_data)
 {
@@ -319,14 +543,16 @@ resize_cb(GtkStatusIcon *app_icon, gint newsize, gpointer user_data)
     width = newsize;
 
     if (!screensaver) {
-        if (pixmap) g_object_unref(pixmap);
-        pixmap = gdk_pixmap_new(NULL, width, width, 24);
+        if (icon_pixbuf) g_object_unref(icon_pixbuf);
+        icon_pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, width, width);
+        icon_pixels = gdk_pixbuf_get_pixels(icon_pixbuf);
+        icon_rowstride = gdk_pixbuf_get_rowstride(icon_pixbuf);
+        icon_height = width;
+        icon_columns = g_renew(IconColumn, icon_columns, width);
+        icon_columns_prev = g_renew(IconColumn, icon_columns_prev, width);
+        icon_damaged = TRUE;
     }
 
-    if (gc)  g_object_unref(gc);
-    gc = gdk_gc_new(pixmap);
-    gdk_gc_set_line_attributes(gc, 1, GDK_LINE_SOLID, GDK_CAP_NOT_LAST, GDK_JOIN_MITER);
-
     for(int i=0; i<G_N_ELEMENTS(termometer); i++)
     {
         termometer[i].x = Termometer[i].x*newsize/Termometer_scale;
@@ -342,36 +568,73 @@ resize_cb(GtkStatusIcon *app_icon, gint newsize, gpointer user_data)
 }
 
 MemInfo update_history() {
+    gint64 t0 = prof_now_ns();
     history[0].cpu = cpu_usage(SCALE);
+    prof_end(PS_CPU_USAGE, t0);
     int freq = cpu_freq(); // Frequency in MHz
     history[0].freq = scaling_max_freq > scaling_min_freq ?
         (freq - scaling_min_freq) * SCALE / (scaling_max_freq-scaling_min_freq) : 0;
     history[0].temp = cpu_temperature();
+    t0 = prof_now_ns();
     MemInfo mi = mem_info();
+    prof_end(PS_MEM_INFO, t0);
     if (mi.Total_MB)
         history[0].free_memory = mi.Available_MB * SCALE / mi.Total_MB;
     history[0].net_rx_KBps = net_rx_KBps;
     history[0].net_tx_KBps = net_tx_KBps;
+    history[0].sched = sched_stats;
     return mi;
 }
 
-void refresh_info_text(void)
+void refresh_snapshot(void)
 {
-    net_dev_refresh(refresh_interval_ms);
-    MemInfo meminfo = update_history();
-    top_procs_refresh();
+    // Rates use the real elapsed time: ticks are stretched when idle and GLib
+    // may fire second-granularity timers a bit early or late.
+    static gint64 last_us = 0;
+    gint64 now_us = g_get_monotonic_time();
+    int tick_ms = last_us ? MAX(1, (now_us - last_us) / 1000) : refresh_interval_ms;
+    last_us = now_us;
+
+    gint64 t0 = prof_now_ns(), refresh_t0 = t0;
+    net_dev_refresh(tick_ms);
+    prof_end(PS_NET_DEV, t0);
+    MemInfo mem = update_history();
+    if (snapshot_procs) {
+        top_procs_refresh(tick_ms);
+        threads_refresh();
+    }
+
+    snapshot.generation++;
+    snapshot.time = time(NULL);
+    snapshot.cpu = history[0].cpu;
+    snapshot.freq_MHz = MAX(scaling_cur_freq, 0);
+    snapshot.temp = history[0].temp;
+    snapshot.mem = mem;
+    snapshot.net_rx_KBps = net_rx_KBps;
+    snapshot.net_tx_KBps = net_tx_KBps;
+    snapshot.sched = history[0].sched;
+    quantiles_add(prof_now_ns() - refresh_t0);
+    shm_publish();
+}
+
+const char* info_text_get(void)
+{
+    if (!snapshot.generation)
+        return GATOTRAY_VERSION;
+    if (info_text && info_text_generation == snapshot.generation)
+        return info_text->str;
+    info_text_generation = snapshot.generation;
 
     if (!info_text)
         info_text = g_string_new(NULL);
 
-    time_t now = time(NULL);
     if (screensaver)
-        g_string_assign(info_text, ctime(&now));
+        g_string_assign(info_text, ctime(&snapshot.time));
     else
         g_string_set_size(info_text, 0);
 
-    const char* cpu_icon = PERCENT(history[0].cpu.usage) > CPU_HIGH_THRESHOLD ? "📈" : "📉";
-    const char* io_icon = PERCENT(history[0].cpu.iowait) < IO_WAIT_THRESHOLD ? "🔄" : "⏳";
+    const char* cpu_icon = PERCENT(snapshot.cpu.usage) > CPU_HIGH_THRESHOLD ? "📈" : "📉";
+    const char* io_icon = PERCENT(snapshot.cpu.iowait) < IO_WAIT_THRESHOLD ? "🔄" : "⏳";
 
     char since_buf[32] = "";
     if (start_time) {
@@ -381,23 +644,152 @@ void refresh_info_text(void)
     g_string_append_printf(info_text, GATOTRAY_VERSION "  (running since %s)"
         "\n%s  CPU %d%% busy, %s  %d%% on I/O-wait @ %d MHz"
         , since_buf
-        , cpu_icon, PERCENT(history[0].cpu.usage), io_icon, PERCENT(history[0].cpu.iowait), scaling_cur_freq);
-
-    if (meminfo.Total_MB)
+        , cpu_icon, PERCENT(snapshot.cpu.usage), io_icon, PERCENT(snapshot.cpu.iowait), snapshot.freq_MHz);
+    // The rarer modes only when they take something
+    const struct { const char* name; int value; } modes[] = {
+        { "irq", snapshot.cpu.irq }, { "softirq", snapshot.cpu.softirq },
+        { "guest", snapshot.cpu.guest }, { "steal", snapshot.cpu.steal },
+    };
+    for (int i = 0; i < G_N_ELEMENTS(modes); i++)
+        if (PERCENT(modes[i].value))
+            g_string_append_printf(info_text, ", %d%% %s", PERCENT(modes[i].value), modes[i].name);
+
+    g_string_append_printf(info_text, "\n🍴  %d forks/s, %d running, %d blocked"
+        ", %d context switches/s, %d interrupts/s", snapshot.sched.forks
+        , snapshot.sched.running, snapshot.sched.blocked, snapshot.sched.ctxt, snapshot.sched.intr);
+
+    if (snapshot.mem.Total_MB)
         g_string_append_printf(info_text, "\n💾  Free RAM: %d/%d MB"
-            , RESCALE(history[0].free_memory, meminfo.Total_MB), meminfo.Total_MB);
+            , snapshot.mem.Available_MB, snapshot.mem.Total_MB);
+
+    if (snapshot.temp)
+        g_string_append_printf(info_text, ". 🌡️  Temperature: %d°C", snapshot.temp);
+
+    quantiles_append_summary(info_text);
+
+    if (shm_client)
+        shm_client_append_summary(info_text);
+    else {
+        net_stats_append_summary(info_text);
+        top_procs_append_summary(info_text, snapshot.mem.Available_MB);
+        threads_append_summary(info_text);
+    }
+    if (app_icon)
+        g_string_append_printf(info_text, "\n🖼️  Icon frames: %u drawn, %u unchanged skipped"
+            , icon_frames_drawn, icon_frames_skipped);
+    if (pref_profile_tooltip)
+        prof_append_summary(info_text);
+    return info_text->str;
+}
+
+#include "stream.c"
+#include "exporter.c"
+
+// Screensaver animation: a render-only loop, decoupled from sampling, that
+// interpolates between the last two history snapshots at pref_ss_fps.
+// GTK2 has no frame clock, so frames are paced on an absolute monotonic
+// schedule, and the rate backs off when rendering exceeds pref_ss_cpu_budget
+// percent of a core.
+static CPUstatus *history_prev = NULL, *ss_interp = NULL;
+static int interp_size = 0;
+static gint64 sample_time_us = 0, anim_next_us = 0;
+static guint anim_source = 0;
+static int anim_fps = 0;
+static float anim_cpu_share = 0; // Smoothed fraction of a core spent rendering
+
+static gint64 thread_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static gboolean anim_frame_cb(gpointer data)
+{
+    anim_source = 0;
+    if (!pref_ss_fps || !gdk_window_is_viewable(screensaver) || interp_size < width)
+        return FALSE; // Restarted by timeout_cb once visible again
+
+    gint64 now = g_get_monotonic_time();
+    const int _1 = 1<<10; // Q10 interpolation factor
+    int t = MIN(_1, (now - sample_time_us) * _1 / (MAX(sched_interval_ms, refresh_interval_ms) * 1000LL));
+    #define lerp(field) ss_interp[i].field = history_prev[i].field \
+        + (gint64)(history[i].field - history_prev[i].field) * t / _1
+    for (int i = 0; i < width; i++) {
+        lerp(cpu.usage);
+        lerp(cpu.iowait);
+        lerp(cpu.irq);
+        lerp(cpu.softirq);
+        lerp(cpu.steal);
+        lerp(cpu.guest);
+        lerp(freq);
+        lerp(temp);
+        lerp(free_memory);
+        lerp(net_rx_KBps);
+        lerp(net_tx_KBps);
+    }
+    #undef lerp
 
-    if (history[0].temp)
-        g_string_append_printf(info_text, ". 🌡️  Temperature: %d°C", history[0].temp);
+    gint64 cpu_ns = thread_cpu_ns();
+    ss_frame = ss_interp;
+    redraw();
+    ss_frame = NULL;
+    cpu_ns = thread_cpu_ns() - cpu_ns;
+
+    // CPU budget guard: drop the rate fast when over budget, recover slowly
+    if (anim_fps > pref_ss_fps) anim_fps = pref_ss_fps;
+    anim_cpu_share += (cpu_ns * anim_fps / 1e9f - anim_cpu_share) / 8;
+    if (anim_cpu_share * 100 > pref_ss_cpu_budget && anim_fps > 1) {
+        int fps = MAX(1, anim_fps * 3 / 4);
+        anim_cpu_share = anim_cpu_share * fps / anim_fps;
+        anim_fps = fps;
+        g_debug("Screensaver over CPU budget, down to %d fps", anim_fps);
+    } else if (anim_cpu_share * 200 < pref_ss_cpu_budget && anim_fps < pref_ss_fps) {
+        anim_fps++;
+    }
 
-    net_stats_append_summary(info_text);
-    top_procs_append_summary(info_text);
+    gint64 frame_us = 1000000 / anim_fps;
+    anim_next_us += frame_us;
+    if (anim_next_us <= now)
+        anim_next_us = now + frame_us; // Fell behind: skip frames rather than burst
+    anim_source = g_timeout_add((anim_next_us - now + 999) / 1000, anim_frame_cb, NULL);
+    return FALSE;
+}
+
+// Called on every sample, before blending, to keep the interpolation base
+static void anim_snapshot(void)
+{
+    if (interp_size != hist_size) {
+        history_prev = g_renew(CPUstatus, history_prev, hist_size);
+        ss_interp = g_renew(CPUstatus, ss_interp, hist_size);
+        interp_size = hist_size;
+    }
+    memcpy(history_prev, history, hist_size * sizeof(*history));
+    sample_time_us = g_get_monotonic_time();
+}
+
+static void anim_start(void)
+{
+    if (anim_source)
+        return;
+    if (!anim_fps)
+        anim_fps = pref_ss_fps;
+    anim_next_us = g_get_monotonic_time();
+    anim_source = g_idle_add(anim_frame_cb, NULL);
 }
 
 int
 timeout_cb (gpointer data)
 {
+    if (shm_client && !shm_client_poll()) {
+        sched_arm(timeout_cb, refresh_interval_ms); // Nothing new from the collector yet
+        return FALSE;
+    }
+    gint64 tick_t0 = prof_now_ns();
     timer++;
+    if (screensaver && pref_ss_fps)
+        anim_snapshot();
+    gint64 t0 = prof_now_ns();
     for(int i = hist_size-1; i > 0; i--)
     {
         // Persistence 'P' is higher for farther history points, so that they take
@@ -420,7 +812,7 @@ timeout_cb (gpointer data)
         // Taking C as a (negative) power of 2 makes all this math fast & accurate with fixed-point
         const int _1 = 1<<15; // For Q15 fixed-point operation
         const int x = _1 * i / hist_size, C = _1/4, P = (_1+C)*x/(C+x);
-        #define blend(dst, src) { dst = (P*dst + (_1-P)*src) / _1; }
+        #define blend(dst, src) { dst = ((gint64)P*dst + (gint64)(_1-P)*src) / _1; }
 
         // Linear
         //const int _1 = hist_size, P = i;
@@ -431,29 +823,74 @@ timeout_cb (gpointer data)
 
         blend(history[i].cpu.usage, history[i-1].cpu.usage);
         blend(history[i].cpu.iowait, history[i-1].cpu.iowait);
+        blend(history[i].cpu.irq, history[i-1].cpu.irq);
+        blend(history[i].cpu.softirq, history[i-1].cpu.softirq);
+        blend(history[i].cpu.steal, history[i-1].cpu.steal);
+        blend(history[i].cpu.guest, history[i-1].cpu.guest);
         blend(history[i].freq, history[i-1].freq);
         blend(history[i].temp, history[i-1].temp);
         blend(history[i].free_memory, history[i-1].free_memory);
         blend(history[i].net_rx_KBps, history[i-1].net_rx_KBps);
         blend(history[i].net_tx_KBps, history[i-1].net_tx_KBps);
+        blend(history[i].sched.ctxt, history[i-1].sched.ctxt);
+        blend(history[i].sched.intr, history[i-1].sched.intr);
+        blend(history[i].sched.forks, history[i-1].sched.forks);
+        blend(history[i].sched.running, history[i-1].sched.running);
+        blend(history[i].sched.blocked, history[i-1].sched.blocked);
         #undef blend
     }
-    refresh_info_text();
-    time_t now = time(NULL);
-    // Tooltip text is supplied on demand via query-tooltip signal — no setter call here.
+    prof_end(PS_HISTORY_BLEND, t0);
+    if (shm_client) {
+        shm_client_apply();
+        quantiles_add(-1); // Percentiles of the collector's samples, minus its latency
+    } else
+        refresh_snapshot();
+    time_t now = snapshot.time;
+    if (!shm_client) { // Followers would repeat the collector's alerts
+        alerts_evaluate();
+        oom_watch_update();
+    }
+    // Tooltip text is formatted on demand via query-tooltip signal — no setter call here.
+
+    if (pref_metrics_log && !shm_client) {
+        int values[MF_COUNT] = {
+            [MF_CPU] = RESCALE(snapshot.cpu.usage, 1000),
+            [MF_IOWAIT] = RESCALE(snapshot.cpu.iowait, 1000),
+            [MF_FREQ] = snapshot.freq_MHz,
+            [MF_TEMP] = snapshot.temp,
+            [MF_MEM_AVAIL] = snapshot.mem.Available_MB,
+            [MF_MEM_TOTAL] = snapshot.mem.Total_MB,
+            [MF_NET_RX] = snapshot.net_rx_KBps,
+            [MF_NET_TX] = snapshot.net_tx_KBps,
+            [MF_STEAL] = RESCALE(snapshot.cpu.steal, 1000),
+        };
+        metrics_log_append(now, values);
+    }
 
-    if (!screensaver || gdk_window_is_viewable(screensaver))
+    if (screensaver && pref_ss_fps) {
+        if (gdk_window_is_viewable(screensaver))
+            anim_start();
+    } else if (!screensaver || gdk_window_is_viewable(screensaver))
         redraw();
 
     // Save history every minute (60 seconds)
     static time_t save_time = 0;
-    if (save_time <= now) {
+    if (save_time <= now && !shm_client) { // The collector keeps the cache
         history_save();
+        metrics_log_flush();
         save_time = now + 60;
     }
 
-    // Re-add every time to handle changes in refresh_interval_ms
-    g_timeout_add(refresh_interval_ms, timeout_cb, NULL);
+    // Re-add every time: the interval adapts to activity and to pref changes
+    SchedSample sample = {
+        .cpu = PERCENT(snapshot.cpu.usage),
+        .iowait = PERCENT(snapshot.cpu.iowait),
+        .net_KBps = snapshot.net_rx_KBps + snapshot.net_tx_KBps,
+        .procs = procs_total,
+        .forks = snapshot.sched.forks,
+    };
+    sched_arm(timeout_cb, sched_next_interval(sample));
+    prof_tick(tick_t0);
     return FALSE;
 }
 
@@ -512,7 +949,7 @@ gboolean
 query_tooltip_cb(GtkStatusIcon* icon, gint x, gint y, gboolean keyboard_mode,
                  GtkTooltip* tooltip, gpointer user_data)
 {
-    gtk_tooltip_set_text(tooltip, info_text ? info_text->str : GATOTRAY_VERSION);
+    gtk_tooltip_set_text(tooltip, info_text_get());
     return TRUE;
 }
 
@@ -571,14 +1008,74 @@ main( int argc, char *argv[] )
     }
 
     // --info: print one info-text snapshot and exit (no GTK / no display required)
-    gboolean info_only = FALSE;
+    // --stats [N]: sample N times (default 10) and print the self profile instead
+    // --root <dir>: read <dir>/proc and <dir>/sys instead (also GATOTRAY_ROOT)
+    // --stream [json|csv] [--fields a,b] [--output file] [--interval ms]:
+    //   headless records for servers, see stream.c
+    // --listen unix:<path>|tcp:<port>: serve OpenMetrics to scrapers, see exporter.c
+    gboolean info_only = FALSE, stream = FALSE;
+    int stats_samples = 0, interval_ms = 0;
+    const char* root = g_getenv("GATOTRAY_ROOT");
+    const char *stream_format = NULL, *stream_fields = NULL, *stream_output = NULL, *listen_on = NULL;
     for (int i = 1; i < argc; i++) {
+        if (g_str_equal(argv[i], "--stream")) {
+            info_only = stream = TRUE;
+            if (i+1 < argc && argv[i+1][0] != '-')
+                stream_format = argv[++i];
+            continue;
+        }
+        const char** stream_opt = g_str_equal(argv[i], "--fields") ? &stream_fields
+            : g_str_equal(argv[i], "--output") ? &stream_output
+            : g_str_equal(argv[i], "--listen") ? &listen_on : NULL;
+        if (stream_opt && i+1 < argc) {
+            *stream_opt = argv[++i];
+            continue;
+        }
+        if (g_str_equal(argv[i], "--interval") && i+1 < argc) {
+            interval_ms = atoi(argv[++i]);
+            continue;
+        }
         if (g_str_equal(argv[i], "--info") || g_str_equal(argv[i], "-i")) {
             info_only = TRUE;
-            break;
+            continue;
+        }
+        if (g_str_equal(argv[i], "--stats")) {
+            info_only = TRUE;
+            stats_samples = i+1 < argc ? atoi(argv[i+1]) : 0;
+            if (stats_samples > 0)
+                i++;
+            else
+                stats_samples = 10;
+            continue;
+        }
+        if (g_str_equal(argv[i], "--root")) {
+            if (i+1 >= argc) {
+                g_printerr("Usage: %s --root <dir containing proc/ and sys/>\n", argv[0]);
+                return 2;
+            }
+            root = argv[++i];
+            continue;
+        }
+        // --query <from> <to> [--step <s>]: aggregate the long-term metrics log
+        if (g_str_equal(argv[i], "--query")) {
+            time_t now = time(NULL);
+            time_t from = i+1 < argc ? metrics_log_parse_time(argv[i+1], now) : -1;
+            time_t to = i+2 < argc ? metrics_log_parse_time(argv[i+2], now) : -1;
+            long step = 0;
+            if (i+4 < argc && g_str_equal(argv[i+3], "--step"))
+                step = metrics_log_parse_step(argv[i+4]);
+            if (from < 0 || to <= from || (i+3 < argc && !step)) {
+                g_printerr("Usage: %s --query <from> <to> [--step <seconds|Nm|Nh|Nd>]\n"
+                    "  times: now, -2h, -7d, epoch seconds or \"YYYY-MM-DD[ HH:MM[:SS]]\"\n", argv[0]);
+                return 2;
+            }
+            return metrics_log_query(from, to, step);
         }
     }
 
+    if (root && root[0] && !root_set(root))
+        return 1;
+
     if (!info_only) {
         gtk_init (&argc, &argv);
         GdkPixbuf* xpm = gdk_pixbuf_new_from_xpm_data(gatotray_xpm);
@@ -586,26 +1083,56 @@ main( int argc, char *argv[] )
     }
 
     pref_init();
+    alerts_load(pref_file);
 
     history = g_malloc(sizeof(*history));
     hist_size = width = 1;
     update_history();
 
+    if (listen_on && (stream || !info_only) && !exporter_listen(listen_on))
+        return 1;
+
+    if (stream) {
+        shm_attach(FALSE);
+        if (interval_ms > 0)
+            refresh_interval_ms = interval_ms;
+        return stream_run(stream_format, stream_fields, stream_output);
+    }
+
     if (info_only) {
         // Force every cadence to fire on each refresh so two close-spaced samples
         // produce meaningful CPU% and KB/s deltas.
         refresh_interval_ms = 500;
         top_refresh_ms = 500;
         heavy_refresh_ms = 500;
-        refresh_info_text();              // prime samples
+        heavy_slice_pids = G_MAXINT;
+        refresh_snapshot();               // prime samples
         g_usleep(500000);
-        refresh_info_text();
-        puts(info_text->str);
+        if (stats_samples) {
+            for (int i = 0; i < stats_samples; i++) {
+                gint64 t0 = prof_now_ns();
+                refresh_snapshot();
+                prof_tick(t0);
+                if (i+1 < stats_samples)
+                    g_usleep(500000);
+            }
+            GString* stats = g_string_new(NULL);
+            prof_append_summary(stats);
+            puts(stats->str + strspn(stats->str, "\n"));
+            return 0;
+        }
+        refresh_snapshot();
+        puts(info_text_get());
         return 0;
     }
 
-    // Load cached history from previous run (may resize hist_size/width)
-    history_load();
+    // Follow an instance that is already collecting, with its live history,
+    // or else load cached history from previous run (may resize hist_size/width)
+    shm_attach(TRUE);
+    if (shm_client)
+        shm_client_load_history();
+    else
+        history_load();
 
     gchar** envp = g_get_environ();
     const gchar* wid = g_environ_getenv(envp,"XSCREENSAVER_WINDOW");
@@ -684,13 +1211,14 @@ main( int argc, char *argv[] )
         gtk_status_icon_set_has_tooltip(app_icon, TRUE);
     }
     g_free(envp);
-    g_timeout_add(refresh_interval_ms, timeout_cb, NULL);
+    sched_arm(timeout_cb, refresh_interval_ms);
     gtk_main();
+    metrics_log_close();
     return 0;
 }
 
 // History cache functions implementation
-static const gchar* history_cache_filename = "gatotray-history.bin";
+static const gchar* history_cache_filename = "gatotray-history3.bin"; // Renamed whenever CPUstatus changes
 
 void history_save(void)
 {
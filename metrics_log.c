@@ -0,0 +1,364 @@
+// Long-term metrics log: append-only segments of delta+varint encoded samples,
+// rotated by size, and a streaming reader for the --query CLI.
+//
+// Segment layout: 4-byte magic "GTL1", then one record per sample:
+//   varint  seconds since previous record (absolute epoch time for the first)
+//   varint  bitmask of fields that changed since the previous record
+//   varint  zigzag(delta) of every changed field, in MetricsField order
+// Each segment starts from all-zero state so it decodes on its own.
+// An idle machine costs ~2 bytes per sample, a busy one rarely more than 10.
+//
+// The writer holds flock(LOCK_EX) on metrics.lock, next to the segments and
+// never rotated. A second collecting instance (e.g. when shared memory is off)
+// finds it locked and does not log, as its records would interleave with a
+// delta base of their own.
+
+#include <time.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+typedef enum {
+    MF_CPU,         // per-mille busy
+    MF_IOWAIT,      // per-mille iowait
+    MF_FREQ,        // MHz
+    MF_TEMP,        // Celsius
+    MF_MEM_AVAIL,   // MB
+    MF_MEM_TOTAL,   // MB
+    MF_NET_RX,      // KB/s
+    MF_NET_TX,      // KB/s
+    MF_STEAL,       // per-mille steal
+    MF_COUNT
+} MetricsField;
+
+#define METRICS_LOG_MAGIC "GTL1"
+#define METRICS_LOG_SEGMENTS 8 // metrics.log + metrics.1.log ... metrics.7.log
+
+gboolean pref_metrics_log = FALSE;
+gint pref_log_segment_kb = 1024;
+
+static FILE* mlog = NULL;
+static int mlog_lock_fd = -1; // Held from the first open until metrics_log_close()
+static long mlog_size = 0;
+static time_t mlog_time = 0;
+static int mlog_values[MF_COUNT];
+
+static gchar* metrics_log_path(int segment)
+{
+    gchar* name = segment ? g_strdup_printf("metrics.%d.log", segment) : g_strdup("metrics.log");
+    gchar* path = g_build_filename(g_get_user_data_dir(), "gatotray", name, NULL);
+    g_free(name);
+    return path;
+}
+
+static inline int varint_put(guint8* out, guint64 v)
+{
+    int n = 0;
+    while (v >= 0x80) {
+        out[n++] = v | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+static inline gboolean varint_get(FILE* f, guint64* v)
+{
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc_unlocked(f);
+        if (c == EOF)
+            return FALSE;
+        *v |= (guint64)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+#define zigzag(d) (((guint64)(d) << 1) ^ (guint64)((gint64)(d) >> 63))
+#define unzigzag(u) ((gint64)((u) >> 1) ^ -(gint64)((u) & 1))
+
+typedef struct {
+    FILE* f;
+    time_t time;
+    int values[MF_COUNT];
+} MetricsLogReader;
+
+// Opens a segment and checks its magic. Returns FALSE if missing or foreign.
+static gboolean metrics_log_reader_open(MetricsLogReader* r, const char* path)
+{
+    memset(r, 0, sizeof(*r));
+    if (!(r->f = fopen(path, "rb")))
+        return FALSE;
+    char magic[4];
+    if (fread(magic, 1, 4, r->f) == 4 && !memcmp(magic, METRICS_LOG_MAGIC, 4))
+        return TRUE;
+    fclose(r->f);
+    r->f = NULL;
+    return FALSE;
+}
+
+// Decodes the next record. Returns FALSE at end of segment or on a truncated tail.
+static gboolean metrics_log_read(MetricsLogReader* r)
+{
+    guint64 dt, mask, u;
+    if (!varint_get(r->f, &dt) || !varint_get(r->f, &mask))
+        return FALSE;
+    for (int i = 0; i < MF_COUNT; i++)
+        if (mask & (1u << i)) {
+            if (!varint_get(r->f, &u))
+                return FALSE;
+            r->values[i] += unzigzag(u);
+        }
+    // Bits beyond MF_COUNT come from a newer writer: skip their payload
+    for (mask >>= MF_COUNT; mask; mask >>= 1)
+        if ((mask & 1) && !varint_get(r->f, &u))
+            return FALSE;
+    r->time += dt;
+    return TRUE;
+}
+
+static void metrics_log_rotate(void)
+{
+    if (mlog) {
+        fclose(mlog);
+        mlog = NULL;
+    }
+    for (int i = METRICS_LOG_SEGMENTS-1; i > 0; i--) {
+        gchar* from = metrics_log_path(i-1);
+        gchar* to = metrics_log_path(i);
+        g_rename(from, to);
+        g_free(from);
+        g_free(to);
+    }
+}
+
+// Resumes the current segment: replays it to recover the delta base and drops
+// any half-written record left behind by a crash. FALSE when it cannot be
+// opened, or when another instance is writing it.
+static gboolean metrics_log_open(void)
+{
+    gchar* path = metrics_log_path(0);
+    gchar* dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0700);
+
+    if (mlog_lock_fd < 0) {
+        gchar* lock_path = g_build_filename(dir, "metrics.lock", NULL);
+        mlog_lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (mlog_lock_fd < 0 || flock(mlog_lock_fd, LOCK_EX | LOCK_NB)) {
+            static gboolean told = FALSE;
+            if (!told)
+                g_message("Cannot lock %s (%s), not logging", lock_path,
+                    errno == EWOULDBLOCK ? "another instance logs" : g_strerror(errno));
+            told = TRUE;
+            if (mlog_lock_fd >= 0)
+                close(mlog_lock_fd);
+            mlog_lock_fd = -1;
+            g_free(lock_path);
+            g_free(dir);
+            g_free(path);
+            return FALSE;
+        }
+        g_free(lock_path);
+    }
+    g_free(dir);
+
+    mlog = fopen(path, "ab");
+    if (!mlog) {
+        g_warning("Failed to open metrics log %s: %s", path, g_strerror(errno));
+        g_free(path);
+        return FALSE;
+    }
+
+    mlog_time = 0;
+    memset(mlog_values, 0, sizeof(mlog_values));
+    mlog_size = 0;
+
+    MetricsLogReader r;
+    struct stat st;
+    if (metrics_log_reader_open(&r, path)) {
+        long good = ftell(r.f);
+        while (metrics_log_read(&r))
+            good = ftell(r.f);
+        fclose(r.f);
+        if (ftruncate(fileno(mlog), good))
+            g_warning("Failed to truncate %s: %s", path, g_strerror(errno));
+        mlog_time = r.time;
+        memcpy(mlog_values, r.values, sizeof(mlog_values));
+        mlog_size = good;
+    } else if (!fstat(fileno(mlog), &st) && st.st_size) { // Not just created
+        g_warning("%s is not a metrics log, rotating it away", path);
+        g_free(path);
+        metrics_log_rotate();
+        return metrics_log_open();
+    }
+
+    if (!mlog_size)
+        mlog_size = fwrite(METRICS_LOG_MAGIC, 1, 4, mlog);
+    g_free(path);
+    return TRUE;
+}
+
+void metrics_log_append(time_t now, const int values[MF_COUNT])
+{
+    // Retried every minute: the instance holding the log may have exited
+    static time_t retry_time = 0;
+    if (!mlog && (now < retry_time || !metrics_log_open())) {
+        if (now >= retry_time)
+            retry_time = now + 60;
+        return;
+    }
+
+    if (mlog_size >= pref_log_segment_kb * 1024L) {
+        metrics_log_rotate();
+        if (!metrics_log_open())
+            return;
+    }
+
+    guint8 rec[10 * (MF_COUNT + 2)];
+    guint64 mask = 0;
+    for (int i = 0; i < MF_COUNT; i++)
+        if (values[i] != mlog_values[i])
+            mask |= 1u << i;
+    int len = varint_put(rec, now > mlog_time ? now - mlog_time : 0);
+    len += varint_put(rec + len, mask);
+    for (int i = 0; i < MF_COUNT; i++)
+        if (mask & (1u << i))
+            len += varint_put(rec + len, zigzag((gint64)values[i] - mlog_values[i]));
+
+    if (fwrite(rec, 1, len, mlog) != len) {
+        g_warning("Failed to append to metrics log: %s", g_strerror(errno));
+        fclose(mlog);
+        mlog = NULL;
+        return;
+    }
+    mlog_size += len;
+    if (now > mlog_time)
+        mlog_time = now;
+    memcpy(mlog_values, values, sizeof(mlog_values));
+}
+
+// Buffered records are flushed on the history_save() cadence, not every tick.
+void metrics_log_flush(void)
+{
+    if (mlog)
+        fflush(mlog);
+}
+
+void metrics_log_close(void)
+{
+    if (mlog)
+        fclose(mlog);
+    mlog = NULL;
+    if (mlog_lock_fd >= 0)
+        close(mlog_lock_fd);
+    mlog_lock_fd = -1;
+}
+
+// Parses a step like "30", "5m", "1h" into seconds. Returns 0 if invalid.
+long metrics_log_parse_step(const char* s)
+{
+    char* end;
+    long n = strtol(s, &end, 10);
+    long unit = !*end ? 1 : *end=='s' ? 1 : *end=='m' ? 60 : *end=='h' ? 3600 : *end=='d' ? 86400 : 0;
+    return end != s && unit && (!*end || !end[1]) && n > 0 ? n*unit : 0;
+}
+
+// Accepts "now", relative "-90m"/"-2h"/"-7d", epoch seconds, or local
+// "YYYY-MM-DD[ HH:MM[:SS]]". Returns -1 if unparseable.
+time_t metrics_log_parse_time(const char* s, time_t now)
+{
+    if (g_str_equal(s, "now"))
+        return now;
+    if (s[0] == '-') {
+        long ago = metrics_log_parse_step(s+1);
+        return ago ? now - ago : -1;
+    }
+    char* end;
+    long long epoch = strtoll(s, &end, 10);
+    if (end != s && !*end)
+        return epoch;
+    static const char* formats[] = { "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S",
+        "%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M", "%Y-%m-%d" };
+    for (int i = 0; i < G_N_ELEMENTS(formats); i++) {
+        struct tm tm = {0};
+        end = strptime(s, formats[i], &tm);
+        if (end && !*end) {
+            tm.tm_isdst = -1;
+            return mktime(&tm);
+        }
+    }
+    return -1;
+}
+
+typedef struct {
+    int samples;
+    gint64 sum[MF_COUNT];
+    int max[MF_COUNT], min[MF_COUNT];
+} MetricsBucket;
+
+static void metrics_bucket_print(time_t start, MetricsBucket* b)
+{
+    if (!b->samples)
+        return;
+    char when[32];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&start));
+    #define avg(f) ((double)b->sum[f] / b->samples)
+    printf("%s,%d,%.1f,%.1f,%.1f,%.0f,%d,%d,%d,%.0f,%.0f,%d,%d,%.1f,%.1f\n", when, b->samples,
+        avg(MF_CPU)/10, b->max[MF_CPU]/10.0, avg(MF_IOWAIT)/10, avg(MF_FREQ), b->max[MF_TEMP],
+        b->min[MF_MEM_AVAIL], b->max[MF_MEM_TOTAL], avg(MF_NET_RX), avg(MF_NET_TX),
+        b->max[MF_NET_RX], b->max[MF_NET_TX], avg(MF_STEAL)/10, b->max[MF_STEAL]/10.0);
+    #undef avg
+    memset(b, 0, sizeof(*b));
+}
+
+// Streams one CSV line per non-empty step in [from, to). Segments are decoded
+// oldest first, record by record, so memory use does not depend on log size.
+int metrics_log_query(time_t from, time_t to, long step)
+{
+    if (step <= 0)
+        step = MAX(1, (to - from + 99) / 100);
+    puts("time,samples,cpu_avg,cpu_max,iowait_avg,freq_mhz,temp_max,"
+         "mem_avail_min_mb,mem_total_mb,net_rx_kbps,net_tx_kbps,net_rx_max,net_tx_max,steal_avg,steal_max");
+
+    MetricsBucket b = {0};
+    time_t bucket = from;
+    int segments = 0;
+    for (int seg = METRICS_LOG_SEGMENTS-1; seg >= 0; seg--) {
+        gchar* path = metrics_log_path(seg);
+        MetricsLogReader r;
+        gboolean ok = metrics_log_reader_open(&r, path);
+        g_free(path);
+        if (!ok)
+            continue;
+        segments++;
+        while (metrics_log_read(&r) && r.time < to) {
+            if (r.time < from)
+                continue;
+            if (r.time >= bucket + step) {
+                metrics_bucket_print(bucket, &b);
+                bucket += (r.time - bucket) / step * step;
+            }
+            for (int i = 0; i < MF_COUNT; i++) {
+                b.sum[i] += r.values[i];
+                if (!b.samples || r.values[i] > b.max[i]) b.max[i] = r.values[i];
+                if (!b.samples || r.values[i] < b.min[i]) b.min[i] = r.values[i];
+            }
+            b.samples++;
+        }
+        gboolean past_end = r.time >= to;
+        fclose(r.f);
+        if (past_end)
+            break;
+    }
+    metrics_bucket_print(bucket, &b);
+    if (!segments) {
+        gchar* path = metrics_log_path(0);
+        g_printerr("No metrics log found at %s (enable \"Long-term metrics log\" in Preferences)\n", path);
+        g_free(path);
+        return 1;
+    }
+    return 0;
+}
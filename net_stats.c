@@ -22,21 +22,22 @@ int net_rx_KBps = 0, net_tx_KBps = 0;
 
 static void net_dev_refresh(int elapsed_ms)
 {
-    static FILE* f = NULL;
-    if (!f) f = fopen("/proc/net/dev", "r");
-    if (!f) return;
-    rewind(f);
-    fflush(f); // /proc files: rewind alone leaves stale buffer
+    static RtFile f = RT_FILE("/proc/net/dev");
+    char buf[4096];
+    if (rt_file_read(&f, buf, sizeof(buf)) < 0) return;
 
-    char line[256];
-    if (!fgets(line, sizeof(line), f)) return;
-    if (!fgets(line, sizeof(line), f)) return;
+    // Skip the two header lines
+    char* line = strchr(buf, '\n');
+    if (line) line = strchr(line + 1, '\n');
+    if (!line) return;
 
     IfaceStat current[8];
     int n = 0;
     int total_rx = 0, total_tx = 0;
 
-    while (n < 8 && fgets(line, sizeof(line), f)) {
+    for (char* next; n < 8 && line && *++line; line = next) {
+        if ((next = strchr(line, '\n')))
+            *next = '\0';
         char* p = line;
         while (*p == ' ') p++;
         char* colon = strchr(p, ':');
@@ -52,7 +53,7 @@ static void net_dev_refresh(int elapsed_ms)
         // rx_bytes packets errs drop fifo frame compressed multicast tx_bytes ...
         // To read rx_bytes and tx_bytes: 1 read, 7 skips, 1 read.
         u64 rx, tx;
-        if (sscanf(colon + 1, " %llu %*u %*u %*u %*u %*u %*u %llu",
+        if (sscanf(colon + 1, " %llu %*u %*u %*u %*u %*u %*u %*u %llu",
                    &rx, &tx) != 2) continue;
         current[n].rx = rx;
         current[n].tx = tx;
@@ -88,6 +89,7 @@ typedef struct {
 
 static SockStat sock_stats[MAX_SOCKETS];
 static int n_socks = 0;
+static gint64 sock_stats_time_us = 0; // When the dump in sock_stats[] was taken
 
 #define SOCK_HASH_SIZE 8192
 #define SOCK_HASH_MASK (SOCK_HASH_SIZE - 1)
@@ -184,6 +186,7 @@ static void inet_diag_refresh(void)
 {
     sock_hash_clear();
     n_socks = 0;
+    sock_stats_time_us = g_get_monotonic_time();
 
     int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_INET_DIAG);
     if (fd < 0) return;
@@ -206,7 +209,7 @@ static int net_count_pid_fds(const char* pid_str)
 {
     char path[64];
     snprintf(path, sizeof(path), "/proc/%s/fd", pid_str);
-    DIR* dir = opendir(path);
+    DIR* dir = root_opendir(path);
     if (!dir) return 0;
     int fd_count = 0;
     struct dirent* ent;
@@ -222,7 +225,7 @@ static int net_collect_pid_sockets(const char* pid_str, unsigned pid, int* socke
 {
     char path[64];
     snprintf(path, sizeof(path), "/proc/%s/fd", pid_str);
-    DIR* dir = opendir(path);
+    DIR* dir = root_opendir(path);
     if (!dir) { *socket_count = 0; return 0; }
 
     int fd_count = 0, socks = 0;
@@ -236,7 +239,7 @@ static int net_collect_pid_sockets(const char* pid_str, unsigned pid, int* socke
         char link[280];
         snprintf(link, sizeof(link), "/proc/%s/fd/%s", pid_str, ent->d_name);
         char target[64];
-        int tlen = readlink(link, target, sizeof(target) - 1);
+        int tlen = root_readlink(link, target, sizeof(target) - 1);
         if (tlen <= 0) continue;
         target[tlen] = '\0';
 
@@ -261,6 +264,7 @@ static void net_inode_map_clear(void) { n_inode_map = 0; }
 typedef struct {
     unsigned pid;
     uint64_t prev_acked, prev_received;
+    gint64 sample_us; // Dump time of prev_acked/prev_received
     int rx_KBps, tx_KBps;
     unsigned min_rtt_us;
 } ProcNetStat;
@@ -276,7 +280,9 @@ static ProcNetStat* net_stat_by_pid(unsigned pid)
     return NULL;
 }
 
-static void net_stats_aggregate(int elapsed_ms)
+// Rates are taken against each pid's own previous sample, so a pid that was
+// missing from a pass (no sockets, or not reached yet) still gets a true rate.
+static void net_stats_aggregate(void)
 {
     // Build temporary per-pid aggregates from inode_map × sock_stats
     typedef struct { unsigned pid; uint64_t acked, received; unsigned min_rtt; } Agg;
@@ -316,25 +322,35 @@ static void net_stats_aggregate(int elapsed_ms)
         ns->pid = aggs[i].pid;
         ns->min_rtt_us = aggs[i].min_rtt;
 
-        if (prev && elapsed_ms > 0 && aggs[i].received >= prev->prev_received) {
+        gint64 elapsed_us = prev ? sock_stats_time_us - prev->sample_us : 0;
+        if (prev && elapsed_us > 0 && aggs[i].received >= prev->prev_received
+                && aggs[i].acked >= prev->prev_acked) {
             uint64_t drx = aggs[i].received - prev->prev_received;
             uint64_t dtx = aggs[i].acked - prev->prev_acked;
-            ns->rx_KBps = (int)(drx * 1000 / elapsed_ms / 1024);
-            ns->tx_KBps = (int)(dtx * 1000 / elapsed_ms / 1024);
+            ns->rx_KBps = (int)(drx * 1000000 / elapsed_us / 1024);
+            ns->tx_KBps = (int)(dtx * 1000000 / elapsed_us / 1024);
         } else {
             ns->rx_KBps = ns->tx_KBps = 0;
         }
         ns->prev_acked = aggs[i].acked;
         ns->prev_received = aggs[i].received;
+        ns->sample_us = sock_stats_time_us;
     }
 
     memcpy(proc_net, new_net, n_new * sizeof(ProcNetStat));
     n_proc_net = n_new;
 }
 
-static void net_stats_refresh(gboolean heavy)
+// Ends a heavy pass: dumps every TCP socket once and attributes it through the
+// inode map collected, possibly over several ticks, since the pass started.
+static void net_stats_refresh(void)
 {
-    if (heavy) inet_diag_refresh();
+    gint64 t0 = prof_now_ns();
+    inet_diag_refresh();
+    prof_end(PS_INET_DIAG, t0);
+    t0 = prof_now_ns();
+    net_stats_aggregate();
+    prof_end(PS_NET_AGGREGATE, t0);
 }
 
 static void net_stats_append_summary(GString* out)
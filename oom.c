@@ -0,0 +1,196 @@
+// Early OOM warning: a PSI trigger on /proc/pressure/memory wakes us up when
+// tasks stall on memory for more than pref_oom_stall_ms within a 2 s window
+// (the shortest window the kernel allows unprivileged users). The trigger
+// fd sits in the collector runtime's epoll set, so nothing is read or computed until pressure
+// actually builds up.
+//
+// On a trigger the victim is chosen from the process list top_procs_refresh()
+// already keeps, scored like the kernel's OOM killer: rss plus oom_score_adj
+// thousandths of total memory, skipping processes with oom_score_adj -1000.
+// It is reported, or with pref_oom_kill sent SIGTERM, then SIGKILL if it is
+// still around on the next trigger. Signals go through a pidfd, after checking
+// the pid still runs the process picked. Nothing is killed with --root: those
+// pids belong to another procfs, maybe another pid namespace.
+
+#include <sys/syscall.h>
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+#define OOM_WINDOW_US 2000000
+#define OOM_KILL_GRACE_US (10 * G_USEC_PER_SEC) // SIGTERM then, if still alive, SIGKILL
+#define OOM_NOTIFY_US (60 * G_USEC_PER_SEC) // Desktop notifications per victim, at most
+
+static int oom_fd = -1;
+static RtSource* oom_source = NULL;
+static unsigned oom_prefs_generation = 0;
+static unsigned oom_victim_pid = 0;
+static gint64 oom_victim_us = 0;
+static unsigned oom_reported_pid = G_MAXUINT; // 0 when nobody was to blame
+static gint64 oom_notified_us = 0;
+
+// oom_score_adj of pid, 0 when unreadable
+static int oom_score_adj(unsigned pid)
+{
+    char path[48], buf[16];
+    snprintf(path, sizeof(path), "/proc/%u/oom_score_adj", pid);
+    int fd = root_open(path), len = fd >= 0 ? read(fd, buf, sizeof(buf)-1) : -1;
+    if (fd >= 0)
+        close(fd);
+    if (len <= 0)
+        return 0;
+    buf[len] = '\0';
+    return atoi(buf);
+}
+
+// Only processes with at least 1/16 of top_mem's rss are scored, so a
+// trigger under memory pressure costs a handful of reads, not one per pid.
+static ProcessInfo* oom_pick_victim(void)
+{
+    if (!top_mem)
+        return NULL;
+    const double total_pages = snapshot.mem.Total_MB / (PAGE_GB() * 1024);
+    ProcessInfo* victim = NULL;
+    double best = 0;
+    for (ProcessInfo* p = top_procs; p; p = p->next) {
+        if (p->rss < top_mem->rss / 16 || p == procs_self || p->pid == 1)
+            continue;
+        int adj = oom_score_adj(p->pid);
+        double points = p->rss + adj * total_pages / 1000;
+        if (adj > -1000 && points > best) {
+            best = points;
+            victim = p;
+        }
+    }
+    return victim;
+}
+
+// starttime of pid (field 22 of its stat), 0 when it is gone
+static ULL oom_starttime(unsigned pid)
+{
+    char path[48], buf[512];
+    snprintf(path, sizeof(path), "/proc/%u/stat", pid);
+    int fd = root_open(path), len = fd >= 0 ? read(fd, buf, sizeof(buf)-1) : -1;
+    if (fd >= 0)
+        close(fd);
+    if (len <= 0)
+        return 0;
+    buf[len] = '\0';
+    char* end = strrchr(buf, ')');
+    ULL starttime = 0;
+    if (end)
+        sscanf(end + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+            &starttime);
+    return starttime;
+}
+
+// The list may be a tick old and pids get reused: the pidfd is checked to
+// still name the process picked, then signalled. FALSE if nothing was sent.
+static gboolean oom_signal(const ProcessInfo* p, int sig)
+{
+    int pidfd = syscall(SYS_pidfd_open, p->pid, 0);
+    if (pidfd < 0) {
+        g_warning("Cannot open pid %u: %s", p->pid, g_strerror(errno));
+        return FALSE;
+    }
+    // From here on the pidfd keeps naming the process read here, even if it exits
+    gboolean same = oom_starttime(p->pid) == p->starttime;
+    if (!same)
+        g_warning("%s (%u) has exited, not signalling", p->comm, p->pid);
+    else if (syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0)) {
+        g_warning("Cannot kill %u: %s", p->pid, g_strerror(errno));
+        same = FALSE;
+    }
+    close(pidfd);
+    return same;
+}
+
+// The trigger fires every 2 s while pressure lasts: log only when the victim
+// changes, and fork notify-send at most once a minute for the same one
+static void oom_report(unsigned pid, const char* text)
+{
+    gint64 now = g_get_monotonic_time();
+    gboolean changed = pid != oom_reported_pid;
+    oom_reported_pid = pid;
+    if (changed)
+        g_warning("Memory pressure: %s", text);
+    if (!pid || (!changed && now - oom_notified_us < OOM_NOTIFY_US))
+        return;
+    oom_notified_us = now;
+    gchar* argv[] = { "notify-send", "-a", "gatotray", "-u", "critical", "Memory pressure", (gchar*)text, NULL };
+    g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, NULL, NULL);
+}
+
+static gboolean oom_pressure_cb(int fd, guint32 events, gpointer data)
+{
+    if (events & EPOLLERR) {
+        g_warning("Memory pressure trigger failed, not watching any more");
+        oom_source = NULL;
+        close(oom_fd);
+        oom_fd = -1;
+        return G_SOURCE_REMOVE;
+    }
+    ProcessInfo* victim = oom_pick_victim();
+    char text[160];
+    if (!victim) {
+        oom_report(0, "no process to blame");
+        return G_SOURCE_CONTINUE;
+    }
+    snprintf(text, sizeof(text), "%s (%u) uses %.0f MB", victim->comm, victim->pid,
+        victim->rss * PAGE_GB() * 1024);
+    if (!pref_oom_kill || root_proc_fd != AT_FDCWD) {
+        static gboolean told = FALSE;
+        if (pref_oom_kill && !told)
+            g_message("Not killing on memory pressure: processes under --root are not ours to signal");
+        told |= pref_oom_kill;
+        oom_report(victim->pid, text);
+        return G_SOURCE_CONTINUE;
+    }
+    gint64 now = g_get_monotonic_time();
+    gboolean again = victim->pid == oom_victim_pid && now - oom_victim_us < OOM_KILL_GRACE_US;
+    g_warning("Memory pressure: %s, sending %s", text, again ? "SIGKILL" : "SIGTERM");
+    if (oom_signal(victim, again ? SIGKILL : SIGTERM) && !again) {
+        oom_victim_pid = victim->pid;
+        oom_victim_us = now;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Registers, re-registers or drops the trigger after preference changes.
+// Cheap enough to call on every tick.
+void oom_watch_update(void)
+{
+    if (oom_prefs_generation == prefs_generation)
+        return;
+    oom_prefs_generation = prefs_generation;
+    static int registered_ms = 0;
+    if (oom_fd >= 0 && registered_ms == pref_oom_stall_ms)
+        return;
+    if (oom_source)
+        rt_remove(oom_source);
+    if (oom_fd >= 0)
+        close(oom_fd);
+    oom_source = NULL;
+    oom_fd = -1;
+    registered_ms = pref_oom_stall_ms;
+    if (!pref_oom_stall_ms)
+        return;
+
+    const char* rel;
+    int dirfd = root_resolve("/proc/pressure/memory", &rel);
+    oom_fd = openat(dirfd, rel, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    char trigger[48];
+    int len = snprintf(trigger, sizeof(trigger), "some %d %d",
+        MIN(pref_oom_stall_ms, OOM_WINDOW_US / 1000) * 1000, OOM_WINDOW_US);
+    if (oom_fd < 0 || write(oom_fd, trigger, len + 1) < 0) {
+        g_warning("Cannot watch memory pressure (needs a kernel with PSI): %s", g_strerror(errno));
+        if (oom_fd >= 0)
+            close(oom_fd);
+        oom_fd = -1;
+        return;
+    }
+    oom_source = rt_add_fd(oom_fd, EPOLLPRI, oom_pressure_cb, NULL);
+}
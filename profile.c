@@ -0,0 +1,135 @@
+// Self-profiling: per-stage latency histograms and read/write syscall counts.
+//
+// Each stage is timed with CLOCK_MONOTONIC (vDSO, no syscall) into a fixed
+// log2 histogram: bucket b holds samples in [2^(b-1), 2^b) ns, so quantiles
+// are bucket upper bounds, exact within a factor of 2. Read and write
+// syscalls are sampled once per tick from /proc/self/io (syscr + syscw,
+// including that read). Others, like openat, getdents or readlinkat, are
+// not counted: there is no cheap per-process total of those.
+
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef enum {
+    PS_CPU_USAGE,
+    PS_MEM_INFO,
+    PS_NET_DEV,
+    PS_PROC_WALK,   // Whole /proc walk, fd collection included
+    PS_FD_COLLECT,  // Sum of per-pid fd scans in one walk
+    PS_SMAPS,       // smaps_rollup reads after a walk
+    PS_INET_DIAG,
+    PS_NET_AGGREGATE,
+    PS_HISTORY_BLEND,
+    PS_REDRAW,
+    PS_TICK,        // Whole timeout_cb
+    PS_COUNT
+} ProfStage;
+
+static const char* prof_stage_names[PS_COUNT] = {
+    "cpu_usage", "mem_info", "net_dev", "proc walk", "fd collect", "smaps_rollup",
+    "inet_diag", "net aggregate", "history blend", "redraw", "whole tick",
+};
+
+#define PROF_BUCKETS 32
+
+typedef struct {
+    guint32 bucket[PROF_BUCKETS];
+    guint32 count;
+    guint64 max;
+} ProfHist;
+
+static ProfHist prof_stages[PS_COUNT];
+static ProfHist prof_syscalls; // read/write family per tick
+
+gboolean pref_profile_tooltip = FALSE;
+
+static inline gint64 prof_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void prof_hist_add(ProfHist* h, guint64 v)
+{
+    int b = v ? 64 - __builtin_clzll(v) : 0;
+    h->bucket[MIN(b, PROF_BUCKETS-1)]++;
+    h->count++;
+    if (v > h->max)
+        h->max = v;
+}
+
+// Upper bound of the bucket holding quantile q (0..100), capped at the max seen
+static guint64 prof_hist_quantile(const ProfHist* h, int q)
+{
+    guint64 rank = ((guint64)h->count * q + 99) / 100, seen = 0;
+    for (int b = 0; b < PROF_BUCKETS; b++)
+        if ((seen += h->bucket[b]) >= MAX(rank, 1))
+            return MIN(1ULL << b, h->max);
+    return h->max;
+}
+
+static inline void prof_end(ProfStage stage, gint64 t0)
+{
+    prof_hist_add(&prof_stages[stage], prof_now_ns() - t0);
+}
+
+static inline void prof_add(ProfStage stage, guint64 ns)
+{
+    prof_hist_add(&prof_stages[stage], ns);
+}
+
+// Closes a tick: records its duration and the read/write syscalls made since the last one
+void prof_tick(gint64 t0)
+{
+    prof_end(PS_TICK, t0);
+
+    static int fd = -2;
+    static guint64 last = 0;
+    if (fd == -2)
+        fd = open("/proc/self/io", O_RDONLY);
+    char buf[256];
+    int len = fd >= 0 ? pread(fd, buf, sizeof(buf)-1, 0) : -1;
+    if (len <= 0)
+        return;
+    buf[len] = '\0';
+    const char *r = strstr(buf, "syscr:"), *w = strstr(buf, "syscw:");
+    if (!r || !w)
+        return;
+    guint64 total = g_ascii_strtoull(r+6, NULL, 10) + g_ascii_strtoull(w+6, NULL, 10);
+    if (last)
+        prof_hist_add(&prof_syscalls, total - last);
+    last = total;
+}
+
+static void prof_format_ns(char* out, size_t size, guint64 ns)
+{
+    if (ns < 10000)
+        snprintf(out, size, "%uns", (unsigned)ns);
+    else if (ns < 10000000)
+        snprintf(out, size, "%uµs", (unsigned)(ns / 1000));
+    else
+        snprintf(out, size, "%ums", (unsigned)(ns / 1000000));
+}
+
+void prof_append_summary(GString* out)
+{
+    g_string_append(out, "\n\n⏱️  Self profile (p50 / p99 / max):");
+    for (int s = 0; s < PS_COUNT; s++) {
+        const ProfHist* h = &prof_stages[s];
+        if (!h->count)
+            continue;
+        char p50[16], p99[16], max[16];
+        prof_format_ns(p50, sizeof(p50), prof_hist_quantile(h, 50));
+        prof_format_ns(p99, sizeof(p99), prof_hist_quantile(h, 99));
+        prof_format_ns(max, sizeof(max), h->max);
+        g_string_append_printf(out, "\n  %s: %s / %s / %s (n=%u)",
+            prof_stage_names[s], p50, p99, max, h->count);
+    }
+    if (prof_syscalls.count)
+        g_string_append_printf(out, "\n  read/write syscalls/tick: %u / %u / %u (n=%u)",
+            (unsigned)prof_hist_quantile(&prof_syscalls, 50),
+            (unsigned)prof_hist_quantile(&prof_syscalls, 99),
+            (unsigned)prof_syscalls.max, prof_syscalls.count);
+}
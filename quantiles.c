@@ -0,0 +1,172 @@
+// Streaming percentiles of the system metrics, in constant memory.
+// Each metric feeds three P² estimators (Jain & Chlamtac, 1985), one per
+// reported quantile: five markers each, adjusted by parabolic interpolation
+// as samples arrive, so no sample is ever stored. Windows tumble every
+// pref_quantile_window_s; figures come from the last complete window, or
+// from the current one until the first window completes.
+
+typedef enum {
+    QM_CPU, QM_IOWAIT, QM_TEMP, QM_NET_RX, QM_NET_TX, QM_LATENCY, QM_COUNT
+} QuantileMetric;
+
+static const double quantile_p[3] = { .50, .95, .99 };
+
+typedef struct {
+    int n;
+    double q[5];   // Marker heights; the middle one estimates the quantile
+    int pos[5];    // Marker positions, 1-based
+} P2Estimator;
+
+typedef struct {
+    P2Estimator est[G_N_ELEMENTS(quantile_p)];
+    double sum;
+    int count;
+} QuantileSketch;
+
+static QuantileSketch quantile_cur[QM_COUNT], quantile_last[QM_COUNT];
+static gboolean quantile_have_last = FALSE;
+static gint64 quantile_window_us = 0; // Start of the current window
+
+static int double_cmp(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void p2_add(P2Estimator* e, double p, double x)
+{
+    double* q = e->q;
+    int* pos = e->pos;
+    if (e->n < 5) {
+        q[e->n++] = x;
+        if (e->n == 5) {
+            qsort(q, 5, sizeof(*q), double_cmp);
+            for (int i = 0; i < 5; i++)
+                pos[i] = i + 1;
+        }
+        return;
+    }
+
+    // Cell k holds x: q[k] <= x < q[k+1], stretching the extremes if needed
+    int k;
+    if (x < q[0]) {
+        q[0] = x;
+        k = 0;
+    } else if (x >= q[4]) {
+        q[4] = x;
+        k = 3;
+    } else
+        for (k = 0; x >= q[k+1]; k++) {}
+    for (int i = k + 1; i < 5; i++)
+        pos[i]++;
+    e->n++;
+
+    // Move the middle markers one step towards their desired positions
+    const double step[5] = { 0, p/2, p, (1+p)/2, 1 };
+    for (int i = 1; i <= 3; i++) {
+        double d = 1 + (e->n - 1) * step[i] - pos[i];
+        if ((d < 1 || pos[i+1] - pos[i] <= 1) && (d > -1 || pos[i-1] - pos[i] >= -1))
+            continue;
+        int s = d > 0 ? 1 : -1;
+        double parabolic = q[i] + (double)s / (pos[i+1] - pos[i-1])
+            * ((pos[i] - pos[i-1] + s) * (q[i+1] - q[i]) / (pos[i+1] - pos[i])
+             + (pos[i+1] - pos[i] - s) * (q[i] - q[i-1]) / (pos[i] - pos[i-1]));
+        if (q[i-1] < parabolic && parabolic < q[i+1])
+            q[i] = parabolic;
+        else // Linear when the parabola would break monotonicity
+            q[i] += s * (q[i+s] - q[i]) / (pos[i+s] - pos[i]);
+        pos[i] += s;
+    }
+}
+
+static double p2_value(const P2Estimator* e, double p)
+{
+    if (e->n >= 5)
+        return e->q[2];
+    double sorted[5];
+    memcpy(sorted, e->q, e->n * sizeof(*sorted));
+    qsort(sorted, e->n, sizeof(*sorted), double_cmp);
+    return e->n ? sorted[(int)(p * (e->n - 1) + .5)] : 0;
+}
+
+// The sketch reported for metric m, NULL before any sample
+static const QuantileSketch* quantile_sketch(QuantileMetric m)
+{
+    const QuantileSketch* s = quantile_have_last ? &quantile_last[m] : &quantile_cur[m];
+    return s->count ? s : NULL;
+}
+
+static double quantile_get(const QuantileSketch* s, int i)
+{
+    return p2_value(&s->est[i], quantile_p[i]);
+}
+
+// Feeds the current snapshot, plus the time refresh_snapshot() took: negative
+// on followers of another collector, which sample nothing themselves
+void quantiles_add(gint64 latency_ns)
+{
+    gint64 now = g_get_monotonic_time();
+    if (!quantile_window_us) {
+        // The first sample averages CPU since boot: only start the window
+        quantile_window_us = now;
+        return;
+    }
+    if (now - quantile_window_us >= (gint64)pref_quantile_window_s * G_USEC_PER_SEC) {
+        memcpy(quantile_last, quantile_cur, sizeof(quantile_cur));
+        memset(quantile_cur, 0, sizeof(quantile_cur));
+        quantile_have_last = TRUE;
+        quantile_window_us = now;
+    }
+
+    double values[QM_COUNT] = {
+        [QM_CPU] = snapshot.cpu.usage * 100.0 / SCALE,
+        [QM_IOWAIT] = snapshot.cpu.iowait * 100.0 / SCALE,
+        [QM_TEMP] = snapshot.temp,
+        [QM_NET_RX] = snapshot.net_rx_KBps,
+        [QM_NET_TX] = snapshot.net_tx_KBps,
+        [QM_LATENCY] = latency_ns / 1e6,
+    };
+    for (int m = 0; m < QM_COUNT; m++) {
+        if ((m == QM_TEMP && !snapshot.temp) || (m == QM_LATENCY && latency_ns < 0))
+            continue; // No sensor, or not sampling here
+        QuantileSketch* s = &quantile_cur[m];
+        for (int i = 0; i < G_N_ELEMENTS(quantile_p); i++)
+            p2_add(&s->est[i], quantile_p[i], values[m]);
+        s->sum += values[m];
+        s->count++;
+    }
+}
+
+static void quantiles_append_one(GString* out, const char* sep, QuantileMetric m,
+    const char* prefix, const char* fmt, const char* unit)
+{
+    const QuantileSketch* s = quantile_sketch(m);
+    if (!s)
+        return;
+    g_string_append_printf(out, "%s%s", sep, prefix);
+    for (int i = 0; i < G_N_ELEMENTS(quantile_p); i++) {
+        if (i)
+            g_string_append_c(out, '/');
+        g_string_append_printf(out, fmt, quantile_get(s, i));
+    }
+    g_string_append(out, unit);
+}
+
+void quantiles_append_summary(GString* summary)
+{
+    if (!quantile_sketch(QM_CPU))
+        return;
+    int window_s = pref_quantile_window_s;
+    if (!quantile_have_last) // Partial first window
+        window_s = MAX(1, (g_get_monotonic_time() - quantile_window_us) / G_USEC_PER_SEC);
+    if (window_s % 60)
+        g_string_append_printf(summary, "\n📐  p50/p95/p99 over %d s:", window_s);
+    else
+        g_string_append_printf(summary, "\n📐  p50/p95/p99 over %d min:", window_s / 60);
+    quantiles_append_one(summary, " ", QM_CPU, "CPU ", "%.0f", "%");
+    quantiles_append_one(summary, ", ", QM_IOWAIT, "I/O ", "%.0f", "%");
+    quantiles_append_one(summary, ", ", QM_TEMP, "", "%.0f", "°C");
+    quantiles_append_one(summary, ", ", QM_NET_RX, "↓", "%.0f", "");
+    quantiles_append_one(summary, " ", QM_NET_TX, "↑", "%.0f", "KB/s");
+    quantiles_append_one(summary, ", ", QM_LATENCY, "sampling ", "%.2g", "ms");
+}
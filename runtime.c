@@ -0,0 +1,163 @@
+// Collector runtime: one epoll fd, attached to the GLib main loop as a
+// single GSource, multiplexes every collector wake-up: the sampling timer
+// (a timerfd) and event fds such as PSI triggers. Adding sources adds no
+// wake-ups of its own, and an idle gatotray costs one epoll_wait per tick.
+//
+// Periodic readers use RtFile instead of stdio: the fd is opened once and
+// re-read with a single pread() from offset 0, which for procfs and sysfs
+// regenerates the contents without seeking or buffer flushing.
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+typedef gboolean (*RtFdFunc)(int fd, guint32 events, gpointer data); // FALSE removes the source
+
+typedef struct RtSource {
+    int fd;
+    RtFdFunc func;
+    gpointer data;
+    GSourceFunc timer_func; // Timers only: called on expiry
+    gboolean dead; // Removed while dispatching, freed afterwards
+    struct RtSource* next_dead;
+} RtSource;
+
+static int rt_epoll_fd = -1;
+static gboolean rt_dispatching = FALSE;
+static RtSource* rt_dead = NULL;
+
+// Stops watching; the fd itself stays open, except for timers
+void rt_remove(RtSource* s)
+{
+    epoll_ctl(rt_epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+    if (s->timer_func)
+        close(s->fd);
+    if (rt_dispatching) {
+        s->dead = TRUE; // Later events of this batch may still point at it
+        s->next_dead = rt_dead;
+        rt_dead = s;
+    } else
+        g_free(s);
+}
+
+static gboolean rt_dispatch(GSource* source, GSourceFunc callback, gpointer user_data)
+{
+    struct epoll_event events[16];
+    int n = epoll_wait(rt_epoll_fd, events, G_N_ELEMENTS(events), 0);
+    rt_dispatching = TRUE;
+    for (int i = 0; i < n; i++) {
+        RtSource* s = events[i].data.ptr;
+        if (!s->dead && !s->func(s->fd, events[i].events, s->data))
+            rt_remove(s);
+    }
+    rt_dispatching = FALSE;
+    while (rt_dead) {
+        RtSource* s = rt_dead;
+        rt_dead = s->next_dead;
+        g_free(s);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs rt_source_funcs = { NULL, NULL, rt_dispatch, NULL };
+
+static void rt_init(void)
+{
+    if (rt_epoll_fd >= 0)
+        return;
+    rt_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (rt_epoll_fd < 0)
+        g_error("epoll_create1: %s", g_strerror(errno));
+    GSource* source = g_source_new(&rt_source_funcs, sizeof(GSource));
+    g_source_add_unix_fd(source, rt_epoll_fd, G_IO_IN);
+    g_source_set_name(source, "gatotray collectors");
+    g_source_attach(source, NULL);
+}
+
+// Watches fd for epoll events (EPOLLIN, EPOLLPRI...). NULL on failure.
+RtSource* rt_add_fd(int fd, guint32 events, RtFdFunc func, gpointer data)
+{
+    rt_init();
+    RtSource* s = g_new0(RtSource, 1);
+    s->fd = fd;
+    s->func = func;
+    s->data = data;
+    struct epoll_event ev = { .events = events, .data.ptr = s };
+    if (epoll_ctl(rt_epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+        g_warning("Cannot watch fd %d: %s", fd, g_strerror(errno));
+        g_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static gboolean rt_timer_expired(int fd, guint32 events, gpointer data)
+{
+    RtSource* s = data;
+    guint64 expirations;
+    if (read(fd, &expirations, sizeof(expirations)) > 0)
+        s->timer_func(NULL); // One-shot: the callback re-arms if it wants more
+    return TRUE;
+}
+
+// A disarmed timerfd source; see rt_timer_arm()
+RtSource* rt_add_timer(GSourceFunc func)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+        g_error("timerfd_create: %s", g_strerror(errno));
+    RtSource* s = rt_add_fd(fd, EPOLLIN, rt_timer_expired, NULL);
+    if (!s)
+        g_error("Cannot watch timerfd");
+    s->data = s;
+    s->timer_func = func;
+    return s;
+}
+
+// Fires the timer once, interval_ms from now. Whole-second intervals land on
+// whole seconds of the monotonic clock, as g_timeout_add_seconds() does, so
+// they coalesce with other such wake-ups.
+void rt_timer_arm(RtSource* s, int interval_ms)
+{
+    struct itimerspec when = {{0}};
+    int flags = 0;
+    if (interval_ms >= 1000 && interval_ms % 1000 == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        when.it_value.tv_sec = now.tv_sec + interval_ms / 1000 + (now.tv_nsec >= 500000000);
+        flags = TFD_TIMER_ABSTIME;
+    } else {
+        when.it_value.tv_sec = interval_ms / 1000;
+        when.it_value.tv_nsec = interval_ms % 1000 * 1000000L + (interval_ms ? 0 : 1);
+    }
+    timerfd_settime(s->fd, flags, &when, NULL);
+}
+
+// A procfs/sysfs file kept open and re-read whole on every sample
+typedef struct {
+    const char* path;
+    int fd; // -1 until first read
+} RtFile;
+
+#define RT_FILE(p) { (p), -1 }
+
+// Reads up to size-1 bytes from the start of f and NUL terminates them.
+// Returns the length, or -1 (with errno) when the file cannot be read.
+int rt_file_read(RtFile* f, char* buf, size_t size)
+{
+    if (f->fd < 0 && (f->fd = root_open(f->path)) < 0)
+        return -1;
+    ssize_t len = pread(f->fd, buf, size - 1, 0);
+    if (len < 0)
+        return -1;
+    buf[len] = '\0';
+    return len;
+}
+
+// Points f at another path (or none), closing the old fd
+void rt_file_set_path(RtFile* f, const char* path)
+{
+    if (f->fd >= 0)
+        close(f->fd);
+    f->fd = -1;
+    f->path = path;
+}
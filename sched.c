@@ -0,0 +1,52 @@
+// Adaptive sampling scheduler: stretches the tick interval while CPU, network,
+// the process count and the fork rate stay flat, and snaps back to
+// refresh_interval_ms as soon as any of them moves past pref_wake_threshold.
+// Ticks come from one timerfd in the collector runtime, aligned to whole
+// seconds once stretched.
+
+gint sched_interval_ms = 0; // Interval armed for the next tick
+
+typedef struct { int cpu, iowait, net_KBps, procs, forks; } SchedSample; // forks per second
+
+// Feeds one sample and returns the interval until the next tick.
+// Samples are compared with the baseline taken at the last snap, so a slow
+// ramp is caught as well as a sudden spike.
+int sched_next_interval(SchedSample now)
+{
+    static SchedSample base;
+    static gboolean primed = FALSE;
+    const int thr = pref_wake_threshold;
+
+    if (pref_max_refresh_ms <= refresh_interval_ms)
+        return sched_interval_ms = refresh_interval_ms;
+
+    gboolean moved = !primed
+        || ABS(now.cpu - base.cpu) >= thr
+        || ABS(now.iowait - base.iowait) >= thr
+        || ABS(now.net_KBps - base.net_KBps) * 100 > MAX(base.net_KBps, 16) * thr
+        || ABS(now.procs - base.procs) * 100 > MAX(base.procs, 20) * thr
+        // Fork+exit storms keep the process count flat
+        || ABS(now.forks - base.forks) * 100 > MAX(base.forks, 20) * thr;
+
+    if (moved) {
+        base = now;
+        primed = TRUE;
+        sched_interval_ms = refresh_interval_ms;
+    } else {
+        int next = MAX(sched_interval_ms, refresh_interval_ms) * 3 / 2;
+        if (next >= 1000)
+            next = (next + 999) / 1000 * 1000; // Whole seconds once stretched, rounding up to keep growing
+        sched_interval_ms = MAX(MIN(next, pref_max_refresh_ms), refresh_interval_ms);
+    }
+    return sched_interval_ms;
+}
+
+// One tick pending at a time: arming again replaces the callback and delay
+void sched_arm(GSourceFunc callback, int interval_ms)
+{
+    static RtSource* timer = NULL;
+    if (!timer)
+        timer = rt_add_timer(callback);
+    timer->timer_func = callback;
+    rt_timer_arm(timer, interval_ms);
+}
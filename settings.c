@@ -19,15 +19,21 @@ static GKeyFile* pref_file = NULL;
 
 gboolean pref_transparent = TRUE;
 gboolean pref_thermometer = TRUE; // Now controlled by temp sensor dropdown
+gboolean pref_shm_publish = TRUE; // See shm.c
+gboolean pref_oom_kill = FALSE; // See oom.c
 typedef struct {
     const gchar* description;
     gboolean* value;
 } PrefBoolean;
 PrefBoolean pref_booleans[] = {
     { "Transparent background", &pref_transparent },
+    { "Long-term metrics log", &pref_metrics_log },
+    { "Self-profile in tooltip", &pref_profile_tooltip },
+    { "Share samples with local tools (/dev/shm)", &pref_shm_publish },
+    { "Kill top memory user under memory pressure", &pref_oom_kill },
 };
 
-GdkColor mem_color, fg_color, bg_color, iow_color, net_tx_color, net_rx_color;
+GdkColor mem_color, fg_color, bg_color, iow_color, steal_color, irq_color, guest_color, net_tx_color, net_rx_color;
 #define SHADES 100
 #define MAX_SHADE (SHADES-1)
 GdkColor temp_min_color, temp_max_color, temp_gradient[SHADES];
@@ -42,6 +48,9 @@ PrefColor pref_colors[] = {
     { "Foreground", "black", &fg_color },
     { "Background", "white", &bg_color },
     { "I/O wait (bottom)", "blue", &iow_color },
+    { "CPU steal (above I/O wait)", "magenta", &steal_color },
+    { "IRQ and softirq (base of busy)", "#804000", &irq_color },
+    { "Guest VMs (over IRQ)", "#A0A0A0", &guest_color },
     { "Network uplink",   "#E08000", &net_tx_color },
     { "Network downlink", "#E0E000", &net_rx_color },
     { "Min frequency", "green", &freq_min_color },
@@ -53,7 +62,14 @@ PrefColor pref_colors[] = {
 gint refresh_interval_ms = 1000;
 gint top_refresh_ms = 3000;
 gint heavy_refresh_ms = 10000;
+gint heavy_slice_pids = 0; // Pids visited per tick by a heavy pass, 0 spreads it over heavy_refresh_ms
+gint pref_max_refresh_ms = 4000; // Idle backoff ceiling, see sched.c
+gint pref_wake_threshold = 5; // Percent points of CPU / percent change of net & procs
 gint pref_temp_alarm = 85;
+gint pref_ss_fps = 30;
+gint pref_ss_cpu_budget = 10;
+gint pref_oom_stall_ms = 300; // Memory stall per 2 s PSI window that raises the alarm, see oom.c
+gint pref_quantile_window_s = 900; // See quantiles.c
 typedef struct {
     const gchar* description;
     gint* value;
@@ -66,7 +82,15 @@ PrefRangeval pref_rangevals[] = {
     { "Basic refresh interval (ms)", &refresh_interval_ms, 100, 100000 },
     { "Top refresh interval (ms)", &top_refresh_ms, 100, 100000 },
     { "Heavy refresh interval (ms)", &heavy_refresh_ms, 100, 600000 },
+    { "Heavy scan pids per tick (0=auto)", &heavy_slice_pids, 0, 100000 },
+    { "Max idle refresh interval (ms)", &pref_max_refresh_ms, 100, 600000 },
+    { "Idle wake-up threshold (%)", &pref_wake_threshold, 1, 100 },
     { "High temperature alarm", &pref_temp_alarm, 30, 100, &pref_thermometer },
+    { "Screensaver frame rate (0=per sample)", &pref_ss_fps, 0, 60 },
+    { "Screensaver CPU budget (% of a core)", &pref_ss_cpu_budget, 1, 100 },
+    { "Metrics log segment (KB)", &pref_log_segment_kb, 16, 65536, &pref_metrics_log },
+    { "Memory pressure alarm (stall ms per 2 s, 0=off)", &pref_oom_stall_ms, 0, 2000 },
+    { "Percentile window (s)", &pref_quantile_window_s, 10, 86400 },
 };
 
 
@@ -97,7 +121,11 @@ PrefCombo pref_combos[] = {
     { "Thermal zone", thermal_zone_populate, G_CALLBACK(on_temp_sensor_changed) },
 };
 
+// Bumped on every preference change, so cached renderings know to refresh
+unsigned prefs_generation = 0;
+
 void preferences_changed() {
+    prefs_generation++;
     for(int i=0;i<SHADES;i++) {
         freq_gradient[i].red = (freq_min_color.red*(MAX_SHADE-i)+freq_max_color.red*i)/MAX_SHADE;
         freq_gradient[i].green = (freq_min_color.green*(MAX_SHADE-i)+freq_max_color.green*i)/MAX_SHADE;
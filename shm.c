@@ -0,0 +1,279 @@
+// Shared memory publisher: copies every sample into the seqlocked segment
+// described in gatotray-shm.h, for local tools that would otherwise parse
+// /proc again. Publishing is a few hundred bytes of stores per sample.
+//
+// The segment also makes one gatotray the collector for all instances: the
+// one holding its flock publishes, and later instances (typically the
+// screensaver next to the tray icon) follow it as render-only clients,
+// starting from its live history instead of the minute-old cache file.
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gatotray-shm.h"
+
+// History columns are copied in and out as they are: every field must sit
+// where the public layout says
+#define SHM_SAME_FIELD(ours, theirs) \
+    G_STATIC_ASSERT(offsetof(CPUstatus, ours) == offsetof(GatotrayShmColumn, theirs) \
+        && sizeof(((CPUstatus*)0)->ours) == sizeof(((GatotrayShmColumn*)0)->theirs))
+G_STATIC_ASSERT(sizeof(CPUstatus) == sizeof(GatotrayShmColumn));
+SHM_SAME_FIELD(cpu.usage, cpu_usage);
+SHM_SAME_FIELD(cpu.iowait, cpu_iowait);
+SHM_SAME_FIELD(cpu.irq, cpu_irq);
+SHM_SAME_FIELD(cpu.softirq, cpu_softirq);
+SHM_SAME_FIELD(cpu.steal, cpu_steal);
+SHM_SAME_FIELD(cpu.guest, cpu_guest);
+SHM_SAME_FIELD(freq, freq);
+SHM_SAME_FIELD(temp, temp_c);
+SHM_SAME_FIELD(free_memory, mem_avail);
+SHM_SAME_FIELD(net_rx_KBps, net_rx_kbps);
+SHM_SAME_FIELD(net_tx_KBps, net_tx_kbps);
+SHM_SAME_FIELD(sched.ctxt, ctxt_per_s);
+SHM_SAME_FIELD(sched.intr, intr_per_s);
+SHM_SAME_FIELD(sched.forks, forks_per_s);
+SHM_SAME_FIELD(sched.running, procs_running);
+SHM_SAME_FIELD(sched.blocked, procs_blocked);
+#undef SHM_SAME_FIELD
+
+static GatotrayShm* shm_segment = NULL; // Mapped writable while we are the collector
+static const GatotrayShm* shm_peer = NULL; // Mapped read-only while following another one
+static int shm_fd = -1;
+static GatotrayShm shm_sample; // Last sample read as a client
+gboolean shm_client = FALSE;
+
+static void shm_map_collector(void)
+{
+    void* map = MAP_FAILED;
+    if (ftruncate(shm_fd, sizeof(GatotrayShm))
+            || (map = mmap(NULL, sizeof(GatotrayShm), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0)) == MAP_FAILED) {
+        g_warning("Cannot map shared memory: %s", g_strerror(errno));
+        return;
+    }
+    shm_segment = map;
+    // A previous publisher may have died mid-write: restart from an even seq
+    shm_segment->seq = (shm_segment->seq + 1) & ~1u;
+    shm_segment->magic = GATOTRAY_SHM_MAGIC;
+    shm_segment->version = GATOTRAY_SHM_VERSION;
+    shm_segment->size = sizeof(GatotrayShm);
+}
+
+// /dev/shm is world-writable: anybody may have created our name first.
+// Only an object of ours that nobody else can open is shared.
+static gboolean shm_private(int fd, struct stat* st)
+{
+    return !fstat(fd, st) && st->st_uid == getuid() && !(st->st_mode & 077);
+}
+
+// Opens /gatotray-<uid> and becomes its collector or, with may_follow, a
+// client of the instance already collecting. Failure only disables sharing.
+void shm_attach(gboolean may_follow)
+{
+    if (!pref_shm_publish)
+        return;
+    char name[32];
+    snprintf(name, sizeof(name), GATOTRAY_SHM_NAME_FORMAT, (unsigned)getuid());
+    shm_fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (shm_fd < 0) {
+        g_warning("Cannot open shared memory %s: %s", name, g_strerror(errno));
+        return;
+    }
+    struct stat st;
+    if (!shm_private(shm_fd, &st)) {
+        g_warning("Shared memory %s is not private to this user (remove /dev/shm%s), not sharing", name, name);
+        close(shm_fd);
+        shm_fd = -1;
+        return;
+    }
+    if (!flock(shm_fd, LOCK_EX | LOCK_NB)) {
+        shm_map_collector();
+        return;
+    }
+    // The collector may hold the lock but not have sized the segment yet:
+    // touching a page past its end would be SIGBUS. Checked again right
+    // before mapping: that is what we are about to trust.
+    void* map = may_follow && errno == EWOULDBLOCK
+        && shm_private(shm_fd, &st) && st.st_size >= sizeof(GatotrayShm)
+        ? mmap(NULL, sizeof(GatotrayShm), PROT_READ, MAP_SHARED, shm_fd, 0) : MAP_FAILED;
+    if (map != MAP_FAILED && gatotray_shm_read(map, &shm_sample)) {
+        shm_peer = map;
+        shm_client = TRUE;
+        g_message("Following the collector in pid %u", shm_sample.pid);
+        return;
+    }
+    // Another instance collects, but we cannot follow it: collect without sharing
+    if (map != MAP_FAILED)
+        munmap(map, sizeof(GatotrayShm));
+    close(shm_fd);
+    shm_fd = -1;
+}
+
+// Replaces our history with the collector's, like history_load() does
+void shm_client_load_history(void)
+{
+    int n = MIN(shm_peer->hist_len, GATOTRAY_SHM_HISTORY);
+    if (hist_size < n) {
+        history = g_renew(CPUstatus, history, n);
+        hist_size = n;
+        if (width < hist_size)
+            width = hist_size;
+    }
+    n = gatotray_shm_read_history(shm_peer, (GatotrayShmColumn*)history, hist_size);
+    for (int i = MAX(n, 1); i < hist_size; i++)
+        history[i] = history[n ? n-1 : 0];
+}
+
+// Polls the collector. Returns TRUE when it has a new sample, or when it is
+// gone and we just took over as the collector.
+gboolean shm_client_poll(void)
+{
+    // Shrunk under our mapping, reading it would be SIGBUS: go our own way
+    struct stat st;
+    if (!shm_private(shm_fd, &st) || st.st_size < sizeof(GatotrayShm)) {
+        g_warning("Shared memory changed under us, collecting without sharing");
+        munmap((void*)shm_peer, sizeof(GatotrayShm));
+        shm_peer = NULL;
+        shm_client = FALSE;
+        close(shm_fd);
+        shm_fd = -1;
+        return TRUE;
+    }
+    GatotrayShm s;
+    if (gatotray_shm_read(shm_peer, &s) && s.generation != shm_sample.generation) {
+        shm_sample = s;
+        return TRUE;
+    }
+    // A live collector holds the lock; an exited one leaves it free
+    if (flock(shm_fd, LOCK_EX | LOCK_NB))
+        return FALSE;
+    g_message("Collector in pid %u is gone, collecting", shm_sample.pid);
+    munmap((void*)shm_peer, sizeof(GatotrayShm));
+    shm_peer = NULL;
+    shm_client = FALSE;
+    shm_map_collector();
+    return TRUE;
+}
+
+// Takes the collector's sample as ours; history[0] is its newest column
+void shm_client_apply(void)
+{
+    const GatotrayShm* s = &shm_sample;
+    snapshot.generation++;
+    snapshot.time = s->time_ms / 1000;
+    snapshot.cpu.usage = s->cpu_usage;
+    snapshot.cpu.iowait = s->cpu_iowait;
+    snapshot.cpu.irq = s->cpu_irq;
+    snapshot.cpu.softirq = s->cpu_softirq;
+    snapshot.cpu.steal = s->cpu_steal;
+    snapshot.cpu.guest = s->cpu_guest;
+    snapshot.freq_MHz = s->freq_mhz;
+    snapshot.temp = s->temp_c;
+    snapshot.mem.Total_MB = s->mem_total_mb;
+    snapshot.mem.Available_MB = s->mem_avail_mb;
+    snapshot.net_rx_KBps = s->net_rx_kbps;
+    snapshot.net_tx_KBps = s->net_tx_kbps;
+    gatotray_shm_read_history(shm_peer, (GatotrayShmColumn*)history, 1);
+    snapshot.sched = history[0].sched;
+}
+
+void shm_client_append_summary(GString* summary)
+{
+    const GatotrayShm* s = &shm_sample;
+    static const char* icons[GATOTRAY_TOP_COUNT] = {
+        "🔥", "🔥", "🔥", "🔁", "🧠", "🌐", "🔌", "📂", "🧵" };
+    if (s->procs < 0)
+        return;
+    g_string_append_printf(summary, "\n📊  %d processes, %d active", s->procs, s->procs_active);
+    for (int i = 0; i < s->n_top_procs; i++) {
+        int c = 0; // The table is filled in category order: the first user sets the icon
+        while (c < GATOTRAY_TOP_COUNT-1 && s->top[c] != i)
+            c++;
+        const GatotrayShmProc* sp = &s->top_procs[i];
+        ProcessInfo p = {
+            .pid = sp->pid, .rss = sp->rss_bytes / sysconf(_SC_PAGESIZE),
+            .pss = sp->pss_bytes / sysconf(_SC_PAGESIZE), .uss = sp->uss_bytes / sysconf(_SC_PAGESIZE),
+            .swap = sp->swap_bytes / sysconf(_SC_PAGESIZE),
+            .fd_count = sp->fds, .socket_count = sp->sockets, .thread_count = sp->threads,
+            .cpu = sp->cpu_pct, .io_wait = sp->iowait_pct, .average_cpu = sp->avg_cpu_pct,
+            .net_rx_KBps = sp->net_rx_kbps, .net_tx_KBps = sp->net_tx_kbps, .min_rtt_us = sp->min_rtt_us,
+        };
+        g_strlcpy(p.comm, sp->comm, sizeof(p.comm));
+        g_string_append_printf(summary, i ? "\n%s " : "\n\n📊  Top consumers:\n%s ", icons[c]);
+        ProcessInfo_to_GString(&p, summary);
+    }
+}
+
+static int shm_add_proc(GatotrayShm* shm, const ProcessInfo* p)
+{
+    if (!p)
+        return -1;
+    for (int i = 0; i < shm->n_top_procs; i++)
+        if (shm->top_procs[i].pid == p->pid)
+            return i;
+    GatotrayShmProc* out = &shm->top_procs[shm->n_top_procs];
+    out->pid = p->pid;
+    out->threads = p->thread_count;
+    out->fds = p->fd_count;
+    out->sockets = p->socket_count;
+    out->rss_bytes = (guint64)p->rss * sysconf(_SC_PAGESIZE);
+    out->pss_bytes = (guint64)p->pss * sysconf(_SC_PAGESIZE);
+    out->uss_bytes = (guint64)p->uss * sysconf(_SC_PAGESIZE);
+    out->swap_bytes = (guint64)p->swap * sysconf(_SC_PAGESIZE);
+    out->cpu_pct = p->cpu;
+    out->avg_cpu_pct = p->average_cpu;
+    out->iowait_pct = p->io_wait;
+    out->net_rx_kbps = p->net_rx_KBps;
+    out->net_tx_kbps = p->net_tx_KBps;
+    out->min_rtt_us = p->min_rtt_us;
+    g_strlcpy(out->comm, p->comm, sizeof(out->comm));
+    return shm->n_top_procs++;
+}
+
+void shm_publish(void)
+{
+    GatotrayShm* shm = shm_segment;
+    if (!shm || !pref_shm_publish)
+        return;
+    __atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    shm->generation = snapshot.generation;
+    shm->pid = getpid();
+    shm->time_ms = g_get_real_time() / 1000;
+    shm->cpu_usage = snapshot.cpu.usage;
+    shm->cpu_iowait = snapshot.cpu.iowait;
+    shm->cpu_irq = snapshot.cpu.irq;
+    shm->cpu_softirq = snapshot.cpu.softirq;
+    shm->cpu_steal = snapshot.cpu.steal;
+    shm->cpu_guest = snapshot.cpu.guest;
+    shm->freq_mhz = snapshot.freq_MHz;
+    shm->temp_c = snapshot.temp;
+    shm->mem_total_mb = snapshot.mem.Total_MB;
+    shm->mem_avail_mb = snapshot.mem.Available_MB;
+    shm->net_rx_kbps = snapshot.net_rx_KBps;
+    shm->net_tx_kbps = snapshot.net_tx_KBps;
+    shm->procs = snapshot_procs ? procs_total : -1;
+    shm->procs_active = snapshot_procs ? procs_active : -1;
+
+    G_STATIC_ASSERT(GATOTRAY_SHM_PROCS >= GATOTRAY_TOP_COUNT); // Every category fits
+    const ProcessInfo* tops[GATOTRAY_TOP_COUNT] = {
+        [GATOTRAY_TOP_CPU] = top_cpu,
+        [GATOTRAY_TOP_AVG_CPU] = top_avg,
+        [GATOTRAY_TOP_CUMULATIVE] = top_cumulative,
+        [GATOTRAY_TOP_IO] = top_io,
+        [GATOTRAY_TOP_MEM] = top_mem,
+        [GATOTRAY_TOP_NET] = top_net,
+        [GATOTRAY_TOP_SOCKETS] = top_sockets,
+        [GATOTRAY_TOP_FDS] = top_fds,
+        [GATOTRAY_TOP_THREADS] = top_threads,
+    };
+    shm->n_top_procs = 0;
+    for (int c = 0; c < GATOTRAY_TOP_COUNT; c++)
+        shm->top[c] = snapshot_procs ? shm_add_proc(shm, tops[c]) : -1;
+
+    shm->hist_len = MIN(hist_size, GATOTRAY_SHM_HISTORY);
+    memcpy(shm->history, history, shm->hist_len * sizeof(*history));
+
+    __atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,194 @@
+// Headless streaming: --stream [json|csv] emits one record per interval to
+// stdout or --output <file>, without GTK. Every record is formatted into one
+// reused buffer and handed to the kernel with a single write(). A closed
+// reader (EPIPE) ends the stream quietly instead of killing us with SIGPIPE.
+
+#include <fcntl.h>
+
+typedef enum {
+    SF_TIME, SF_CPU, SF_IOWAIT, SF_FREQ, SF_TEMP, SF_MEM_TOTAL, SF_MEM_AVAIL,
+    SF_NET_RX, SF_NET_TX, SF_IRQ, SF_SOFTIRQ, SF_STEAL, SF_GUEST, SF_PROCS, SF_PROCS_ACTIVE,
+    SF_TOP_CPU, SF_TOP_CPU_PCT, SF_TOP_MEM, SF_TOP_MEM_MB, SF_TOP_NET, SF_TOP_NET_KBPS,
+    SF_COUNT
+} StreamField;
+
+static const char* stream_field_names[SF_COUNT] = {
+    "time", "cpu", "iowait", "freq_mhz", "temp_c", "mem_total_mb", "mem_avail_mb",
+    "net_rx_kbps", "net_tx_kbps", "irq", "softirq", "steal", "guest", "procs", "procs_active",
+    "top_cpu", "top_cpu_pct", "top_mem", "top_mem_mb", "top_net", "top_net_kbps",
+};
+#define STREAM_FIRST_PROC_FIELD SF_PROCS // This one and later ones need the /proc walk
+#define STREAM_DEFAULT_FIELDS "time,cpu,iowait,freq_mhz,temp_c,mem_avail_mb,mem_total_mb,net_rx_kbps,net_tx_kbps"
+
+static StreamField stream_fields[SF_COUNT];
+static int n_stream_fields = 0;
+static gboolean stream_json = TRUE;
+static int stream_fd = STDOUT_FILENO;
+static GString* stream_buf = NULL;
+static GMainLoop* stream_loop = NULL;
+static int stream_status = 0;
+
+// Parses a comma separated field list. Returns FALSE on unknown names.
+static gboolean stream_set_fields(const char* list)
+{
+    gchar** names = g_strsplit(list, ",", -1);
+    n_stream_fields = 0;
+    gboolean ok = TRUE;
+    for (int i = 0; names[i] && ok; i++) {
+        int f = 0;
+        while (f < SF_COUNT && !g_str_equal(names[i], stream_field_names[f]))
+            f++;
+        if (f == SF_COUNT || n_stream_fields == SF_COUNT) {
+            g_printerr("Unknown stream field \"%s\"\n", names[i]);
+            ok = FALSE;
+        } else
+            stream_fields[n_stream_fields++] = f;
+    }
+    g_strfreev(names);
+    return ok && n_stream_fields;
+}
+
+static void stream_append_string(const char* s)
+{
+    if (!s) {
+        g_string_append(stream_buf, stream_json ? "null" : "");
+        return;
+    }
+    // comm is printable ASCII already (see ProcessInfo_scan): only quotes,
+    // backslashes and CSV separators need care
+    gboolean quote = stream_json || strpbrk(s, ",\"");
+    if (quote)
+        g_string_append_c(stream_buf, '"');
+    for (; *s; s++) {
+        if (*s == '"')
+            g_string_append(stream_buf, stream_json ? "\\\"" : "\"\"");
+        else if (*s == '\\' && stream_json)
+            g_string_append(stream_buf, "\\\\");
+        else
+            g_string_append_c(stream_buf, *s);
+    }
+    if (quote)
+        g_string_append_c(stream_buf, '"');
+}
+
+static void stream_append_value(StreamField f)
+{
+    GString* out = stream_buf;
+    switch (f) {
+    case SF_TIME: {
+        gint64 ms = g_get_real_time() / 1000;
+        g_string_append_printf(out, "%" G_GINT64_FORMAT ".%03d", ms / 1000, (int)(ms % 1000));
+        break; }
+    case SF_CPU: g_string_append_printf(out, "%.1f", snapshot.cpu.usage * 100.0 / SCALE); break;
+    case SF_IOWAIT: g_string_append_printf(out, "%.1f", snapshot.cpu.iowait * 100.0 / SCALE); break;
+    case SF_FREQ: g_string_append_printf(out, "%d", snapshot.freq_MHz); break;
+    case SF_TEMP: g_string_append_printf(out, "%d", snapshot.temp); break;
+    case SF_MEM_TOTAL: g_string_append_printf(out, "%d", snapshot.mem.Total_MB); break;
+    case SF_MEM_AVAIL: g_string_append_printf(out, "%d", snapshot.mem.Available_MB); break;
+    case SF_NET_RX: g_string_append_printf(out, "%d", snapshot.net_rx_KBps); break;
+    case SF_NET_TX: g_string_append_printf(out, "%d", snapshot.net_tx_KBps); break;
+    case SF_IRQ: g_string_append_printf(out, "%.1f", snapshot.cpu.irq * 100.0 / SCALE); break;
+    case SF_SOFTIRQ: g_string_append_printf(out, "%.1f", snapshot.cpu.softirq * 100.0 / SCALE); break;
+    case SF_STEAL: g_string_append_printf(out, "%.1f", snapshot.cpu.steal * 100.0 / SCALE); break;
+    case SF_GUEST: g_string_append_printf(out, "%.1f", snapshot.cpu.guest * 100.0 / SCALE); break;
+    case SF_PROCS: g_string_append_printf(out, "%d", procs_total); break;
+    case SF_PROCS_ACTIVE: g_string_append_printf(out, "%d", procs_active); break;
+    case SF_TOP_CPU: stream_append_string(top_cpu ? top_cpu->comm : NULL); break;
+    case SF_TOP_CPU_PCT: g_string_append_printf(out, "%.1f", top_cpu ? top_cpu->cpu : 0); break;
+    case SF_TOP_MEM: stream_append_string(top_mem ? top_mem->comm : NULL); break;
+    case SF_TOP_MEM_MB: g_string_append_printf(out, "%.0f", // What it was ranked by: PSS, else rss
+        top_mem ? ProcessInfo_mem(top_mem) * PAGE_GB() * 1024 : 0); break;
+    case SF_TOP_NET: stream_append_string(top_net ? top_net->comm : NULL); break;
+    case SF_TOP_NET_KBPS: g_string_append_printf(out, "%d",
+        top_net ? top_net->net_rx_KBps + top_net->net_tx_KBps : 0); break;
+    default: break;
+    }
+}
+
+// Writes the whole buffer; a short write is only retried, never split up front
+static gboolean stream_flush(void)
+{
+    for (gsize done = 0; done < stream_buf->len; ) {
+        ssize_t n = write(stream_fd, stream_buf->str + done, stream_buf->len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            if (errno != EPIPE) {
+                g_printerr("Stream write failed: %s\n", g_strerror(errno));
+                stream_status = 1;
+            }
+            return FALSE;
+        }
+        done += n;
+    }
+    return TRUE;
+}
+
+static int stream_tick(gpointer data)
+{
+    refresh_snapshot();
+
+    g_string_set_size(stream_buf, 0);
+    if (stream_json)
+        g_string_append_c(stream_buf, '{');
+    for (int i = 0; i < n_stream_fields; i++) {
+        if (i)
+            g_string_append_c(stream_buf, ',');
+        if (stream_json)
+            g_string_append_printf(stream_buf, "\"%s\":", stream_field_names[stream_fields[i]]);
+        stream_append_value(stream_fields[i]);
+    }
+    g_string_append(stream_buf, stream_json ? "}\n" : "\n");
+
+    if (!stream_flush()) {
+        g_main_loop_quit(stream_loop);
+        return FALSE;
+    }
+    sched_arm(stream_tick, refresh_interval_ms);
+    return FALSE;
+}
+
+// Runs until the reader goes away. Returns the process exit status.
+int stream_run(const char* format, const char* fields, const char* output)
+{
+    if (format && !g_str_equal(format, "json") && !g_str_equal(format, "csv")) {
+        g_printerr("Unknown stream format \"%s\", use json or csv\n", format);
+        return 2;
+    }
+    stream_json = !format || g_str_equal(format, "json");
+    if (!stream_set_fields(fields ? fields : STREAM_DEFAULT_FIELDS)) {
+        g_printerr("Available fields:");
+        for (int f = 0; f < SF_COUNT; f++)
+            g_printerr(" %s", stream_field_names[f]);
+        g_printerr("\n");
+        return 2;
+    }
+    if (output && (stream_fd = open(output, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0) {
+        g_printerr("Cannot open %s: %s\n", output, g_strerror(errno));
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    snapshot_procs = FALSE;
+    for (int i = 0; i < n_stream_fields; i++)
+        snapshot_procs |= stream_fields[i] >= STREAM_FIRST_PROC_FIELD;
+
+    stream_buf = g_string_sized_new(256);
+    // CSV header, unless appending to a file that already has one
+    if (!stream_json && lseek(stream_fd, 0, SEEK_END) <= 0) {
+        for (int i = 0; i < n_stream_fields; i++) {
+            if (i)
+                g_string_append_c(stream_buf, ',');
+            g_string_append(stream_buf, stream_field_names[stream_fields[i]]);
+        }
+        g_string_append_c(stream_buf, '\n');
+        if (!stream_flush())
+            return stream_status;
+    }
+
+    refresh_snapshot(); // Prime rate counters; the first record has real deltas
+    stream_loop = g_main_loop_new(NULL, FALSE);
+    sched_arm(stream_tick, refresh_interval_ms);
+    g_main_loop_run(stream_loop);
+    return stream_status;
+}
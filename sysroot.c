@@ -0,0 +1,86 @@
+// Root of the /proc and /sys trees read by the collectors: "/" normally, or
+// e.g. /host when the host's procfs and sysfs are bind-mounted into a
+// container (--root or GATOTRAY_ROOT). Collectors keep using absolute /proc
+// and /sys paths; the root_*() helpers open them relative to dirfds held on
+// the chosen root, so nothing gets concatenated per call.
+
+#include <fcntl.h>
+#include <dirent.h>
+
+static int root_proc_fd = AT_FDCWD, root_sys_fd = AT_FDCWD;
+
+// Returns the dirfd to open path against, and in *rel the path relative to it
+static inline int root_resolve(const char* path, const char** rel)
+{
+    if (root_proc_fd != AT_FDCWD && !strncmp(path, "/proc", 5) && (path[5] == '/' || !path[5])) {
+        *rel = path[5] ? path + 6 : ".";
+        return root_proc_fd;
+    }
+    if (root_sys_fd != AT_FDCWD && !strncmp(path, "/sys", 4) && (path[4] == '/' || !path[4])) {
+        *rel = path[4] ? path + 5 : ".";
+        return root_sys_fd;
+    }
+    *rel = path;
+    return AT_FDCWD;
+}
+
+// Holds dirfds on root/proc and root/sys. A missing sysfs only disables the
+// frequency and temperature readings; a missing procfs is an error.
+gboolean root_set(const char* root)
+{
+    gchar* proc = g_build_filename(root, "proc", NULL);
+    gchar* sys = g_build_filename(root, "sys", NULL);
+    int proc_fd = open(proc, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int sys_fd = open(sys, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    gboolean ok = proc_fd >= 0;
+    if (!ok) {
+        g_printerr("Cannot open %s: %s\n", proc, g_strerror(errno));
+        if (sys_fd >= 0)
+            close(sys_fd);
+    } else {
+        if (sys_fd < 0)
+            g_warning("Cannot open %s: %s", sys, g_strerror(errno));
+        root_proc_fd = proc_fd;
+        root_sys_fd = sys_fd; // -1 makes every sysfs open fail with EBADF
+    }
+    g_free(proc);
+    g_free(sys);
+    return ok;
+}
+
+int root_open(const char* path)
+{
+    const char* rel;
+    int dirfd = root_resolve(path, &rel);
+    return openat(dirfd, rel, O_RDONLY | O_CLOEXEC);
+}
+
+FILE* root_fopen(const char* path)
+{
+    const char* rel;
+    if (root_resolve(path, &rel) == AT_FDCWD)
+        return fopen(path, "r");
+    int fd = root_open(path);
+    FILE* f = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!f && fd >= 0)
+        close(fd);
+    return f;
+}
+
+DIR* root_opendir(const char* path)
+{
+    const char* rel;
+    int dirfd = root_resolve(path, &rel);
+    int fd = openat(dirfd, rel, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* dir = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!dir && fd >= 0)
+        close(fd);
+    return dir;
+}
+
+ssize_t root_readlink(const char* path, char* buf, size_t size)
+{
+    const char* rel;
+    int dirfd = root_resolve(path, &rel);
+    return readlinkat(dirfd, rel, buf, size);
+}
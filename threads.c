@@ -0,0 +1,213 @@
+// Per-thread CPU breakdown for the top CPU consumers.
+// After each /proc walk, the THREAD_SAMPLE_PROCS busiest multi-threaded
+// processes get their /proc/<pid>/task/*/stat read, so a 200-thread JVM shows
+// which of its threads burns the CPU. Idle processes are never looked into.
+// Task directories and stat fds stay open while a process keeps its place,
+// making a sample one getdents plus one pread per thread.
+
+#define THREAD_SAMPLE_PROCS 3 // Processes broken down per thread
+#define THREAD_FD_BUDGET 256  // Task stat fds kept open, all processes together
+#define THREAD_REPORT 3       // Hottest threads listed per process
+
+typedef struct {
+    unsigned tid;
+    int fd; // Cached stat fd, -1 once past THREAD_FD_BUDGET
+    ULL cpu_time;
+    float cpu;
+    char comm[16];
+} ThreadInfo;
+
+typedef struct {
+    unsigned pid;
+    DIR* task_dir;
+    ThreadInfo* tasks; // Ascending tid, for bsearch; the directory is in creation order
+    int n_tasks;
+    ULL sample_time;
+    char comm[32];
+} ThreadSampler;
+
+static ThreadSampler thread_samplers[THREAD_SAMPLE_PROCS];
+static int thread_fds_open = 0;
+static ULL threads_sample_time = 0;
+
+static void thread_close(ThreadInfo* t)
+{
+    if (t->fd >= 0) {
+        close(t->fd);
+        --thread_fds_open;
+    }
+}
+
+static void thread_sampler_clear(ThreadSampler* s)
+{
+    for (int i = 0; i < s->n_tasks; i++)
+        thread_close(&s->tasks[i]);
+    g_free(s->tasks);
+    if (s->task_dir)
+        closedir(s->task_dir);
+    memset(s, 0, sizeof(*s));
+}
+
+// Reads utime+stime and comm of one task; FALSE if it is gone
+static gboolean thread_scan(ThreadSampler* s, ThreadInfo* t)
+{
+    char buf[512], name[32];
+    int len = -1;
+    if (t->fd >= 0)
+        len = pread(t->fd, buf, sizeof(buf)-1, 0);
+    else {
+        snprintf(name, sizeof(name), "%u/stat", t->tid);
+        int fd = openat(dirfd(s->task_dir), name, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            len = read(fd, buf, sizeof(buf)-1);
+            close(fd);
+        }
+    }
+    if (len <= 0)
+        return FALSE;
+    buf[len] = '\0';
+
+    char* comm = strchr(buf, '(');
+    char* end = strrchr(buf, ')');
+    ULL utime, stime;
+    if (!comm || !end || 2 != sscanf(end + 2,
+            "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime))
+        return FALSE;
+    int l = 0;
+    for (++comm; comm < end && l < sizeof(t->comm)-1; comm++)
+        t->comm[l++] = (*comm >= 32 && *comm <= 126) ? *comm : '?';
+    t->comm[l] = '\0';
+    t->cpu_time = utime + stime;
+    return TRUE;
+}
+
+static int thread_tid_cmp(const void* a, const void* b)
+{
+    unsigned x = ((const ThreadInfo*)a)->tid, y = ((const ThreadInfo*)b)->tid;
+    return (x > y) - (x < y);
+}
+
+static void thread_sampler_refresh(ThreadSampler* s)
+{
+    int old_n = s->n_tasks, n = 0, cap = MAX(old_n, 16);
+    ThreadInfo *old = s->tasks, *tasks = g_new(ThreadInfo, cap);
+    float percent_time = 100.0 / MAX(cpu_total_ticks - s->sample_time, 1);
+    struct dirent* entry;
+
+    rewinddir(s->task_dir);
+    while ((entry = readdir(s->task_dir))) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+            continue;
+        unsigned tid = atoi(entry->d_name);
+        if (n == cap)
+            tasks = g_renew(ThreadInfo, tasks, cap *= 2);
+        ThreadInfo* t = &tasks[n];
+        ThreadInfo key = { .tid = tid };
+        ThreadInfo* prev = old_n ? bsearch(&key, old, old_n, sizeof(*old), thread_tid_cmp) : NULL;
+        gboolean known = prev != NULL;
+        if (known) {
+            *t = *prev;
+            prev->fd = -1; // Taken over: not closed below
+        } else {
+            char name[32];
+            snprintf(name, sizeof(name), "%u/stat", tid);
+            t->tid = tid;
+            t->cpu_time = 0;
+            t->fd = thread_fds_open < THREAD_FD_BUDGET
+                ? openat(dirfd(s->task_dir), name, O_RDONLY | O_CLOEXEC) : -1;
+            thread_fds_open += t->fd >= 0;
+        }
+        ULL prev_time = t->cpu_time;
+        if (!thread_scan(s, t)) {
+            thread_close(t);
+            continue;
+        }
+        t->cpu = known && s->sample_time ? (t->cpu_time - prev_time) * percent_time : 0;
+        n++;
+    }
+    // Exited tasks still hold their fds
+    for (int o = 0; o < old_n; o++)
+        thread_close(&old[o]);
+    g_free(old);
+    qsort(tasks, n, sizeof(*tasks), thread_tid_cmp);
+    s->tasks = tasks;
+    s->n_tasks = n;
+    s->sample_time = cpu_total_ticks;
+}
+
+// Runs after top_procs_refresh(), only when it actually walked /proc
+void threads_refresh(void)
+{
+    if (!top_cpu || top_cpu->sample_time == threads_sample_time)
+        return;
+    threads_sample_time = top_cpu->sample_time;
+
+    // Busiest multi-threaded processes, busiest first
+    ProcessInfo* busiest[THREAD_SAMPLE_PROCS] = {NULL};
+    for (ProcessInfo* p = top_procs; p; p = p->next) {
+        if (p->cpu <= 0 || p->thread_count < 2 || p == procs_self)
+            continue;
+        int i = THREAD_SAMPLE_PROCS;
+        while (i > 0 && (!busiest[i-1] || p->cpu > busiest[i-1]->cpu))
+            --i;
+        if (i == THREAD_SAMPLE_PROCS)
+            continue;
+        memmove(&busiest[i+1], &busiest[i], (THREAD_SAMPLE_PROCS-1-i) * sizeof(*busiest));
+        busiest[i] = p;
+    }
+
+    // Keep the samplers of processes still selected, whatever their rank
+    ThreadSampler kept[THREAD_SAMPLE_PROCS] = {{0}};
+    for (int i = 0; i < THREAD_SAMPLE_PROCS; i++) {
+        ThreadSampler* s = &thread_samplers[i];
+        int j = 0;
+        while (j < THREAD_SAMPLE_PROCS && (!busiest[j] || busiest[j]->pid != s->pid))
+            j++;
+        if (s->pid && j < THREAD_SAMPLE_PROCS)
+            kept[j] = *s;
+        else if (s->pid)
+            thread_sampler_clear(s);
+    }
+    memcpy(thread_samplers, kept, sizeof(kept));
+
+    for (int i = 0; i < THREAD_SAMPLE_PROCS && busiest[i]; i++) {
+        ThreadSampler* s = &thread_samplers[i];
+        if (!s->pid) {
+            char path[32];
+            snprintf(path, sizeof(path), "/proc/%u/task", busiest[i]->pid);
+            if (!(s->task_dir = root_opendir(path)))
+                continue;
+            s->pid = busiest[i]->pid;
+        }
+        g_strlcpy(s->comm, busiest[i]->comm, sizeof(s->comm));
+        thread_sampler_refresh(s);
+    }
+}
+
+void threads_append_summary(GString* summary)
+{
+    gboolean header = FALSE;
+    for (int i = 0; i < THREAD_SAMPLE_PROCS; i++) {
+        ThreadSampler* s = &thread_samplers[i];
+        // Pick the hottest few without sorting the whole set
+        ThreadInfo* hot[THREAD_REPORT] = {NULL};
+        for (int t = 0; t < s->n_tasks; t++) {
+            ThreadInfo* ti = &s->tasks[t];
+            int j = THREAD_REPORT;
+            while (j > 0 && (!hot[j-1] || ti->cpu > hot[j-1]->cpu))
+                --j;
+            if (j == THREAD_REPORT || ti->cpu <= .005)
+                continue;
+            memmove(&hot[j+1], &hot[j], (THREAD_REPORT-1-j) * sizeof(*hot));
+            hot[j] = ti;
+        }
+        if (!hot[0])
+            continue;
+        g_string_append_printf(summary, "%s\n%s (%u):",
+            header ? "" : "\n\n🧵  Hottest threads:", s->comm, s->pid);
+        header = TRUE;
+        for (int j = 0; j < THREAD_REPORT && hot[j]; j++)
+            g_string_append_printf(summary, "%s %s %.3g%%cpu (%u)",
+                j ? "," : "", hot[j]->comm, hot[j]->cpu, hot[j]->tid);
+    }
+}
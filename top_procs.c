@@ -5,12 +5,13 @@
 // - Track top file descriptor consumers (modern IDEs)
 // - Track top thread consumers (multi-threaded apps)
 // - Identify processes starving the system
-// - Do OOM kill before it is too late?
+// - Do OOM kill before it is too late (see oom.c)
 
 // Loosely based on procps lib
 #include <unistd.h>
 #include <string.h>
 #include <dirent.h>
+#include <math.h>
 
 #ifdef NDEBUG
 #undef  g_debug
@@ -39,7 +40,11 @@ typedef unsigned long long ULL;
 typedef struct ProcessInfo {
     struct ProcessInfo* next; // embedded single linked list
     unsigned pid, rss, fd_count, socket_count, thread_count;
-    ULL cpu_time, io_time, sample_time;
+    unsigned pss, uss, swap; // Pages, from smaps_rollup; pss is 0 until sampled
+    ULL cpu_time, io_time, sample_time, starttime;
+    gint64 smaps_us; // When smaps_rollup was last read (or found unreadable)
+    int rss_trend; // EWMA of rss growth, pages/min in 24.8 fixed point
+    guint32 cpu_load[3]; // 1, 5 and 15 minute EWMA of cpu, percent in 16.16 fixed point
     float cpu, io_wait, average_cpu;
     int net_rx_KBps, net_tx_KBps;
     unsigned min_rtt_us;
@@ -49,18 +54,65 @@ typedef struct ProcessInfo {
 int procs_total=0, procs_active=0;
 ProcessInfo *top_procs=NULL, *top_cpu=NULL, *top_mem=NULL, *top_avg=NULL, *top_io=NULL
     , *top_cumulative=NULL, *top_fds=NULL, *top_threads=NULL
-    , *top_net=NULL, *top_sockets=NULL, *procs_self=NULL;
+    , *top_net=NULL, *top_sockets=NULL, *top_growth=NULL, *top_load=NULL, *procs_self=NULL;
 
 #define max2decs(g) (g>.005?g:.0)
 
+// smaps_rollup walks every mapping of a process, so it is only read for the
+// SMAPS_CANDIDATES largest processes by rss, at most SMAPS_SLICE per walk,
+// each at most once per heavy_refresh_ms.
+#define SMAPS_CANDIDATES 8
+#define SMAPS_SLICE 2
+
+// rss growth is smoothed over about RSS_TREND_TAU_MS, using only the rss that
+// /proc/<pid>/stat already gives. Slower growth is not worth reporting.
+#define RSS_TREND_TAU_MS 120000
+#define RSS_TREND_MIN_MB_MIN 1
+
+static inline float ProcessInfo_growth_MB_min(const ProcessInfo* p)
+{
+    return p->rss_trend / 256.0f * PAGE_GB() * 1024;
+}
+
+// Per-process CPU averaged like the load average, over 1, 5 and 15 minutes
+static const int cpu_load_window_s[3] = { 60, 300, 900 };
+
+// exp(-elapsed/window) in 16.16 fixed point. Walk intervals repeat (stretched
+// ticks stay on whole seconds), so factors are only recomputed when the
+// interval, rounded to 50 ms, changes.
+static const guint32* cpu_load_decay(int elapsed_ms)
+{
+    static int cached_step = -1;
+    static guint32 decay[3];
+    int step = (elapsed_ms + 25) / 50;
+    if (step != cached_step) {
+        cached_step = step;
+        for (int w = 0; w < 3; w++)
+            decay[w] = exp(-step * 50 / (1000.0 * cpu_load_window_s[w])) * 65536;
+    }
+    return decay;
+}
+
+#define CPU_LOAD(p, w) ((p)->cpu_load[w] / 65536.0f)
+
+// Memory used for ranking: proportional set size once known, else rss
+static inline unsigned ProcessInfo_mem(const ProcessInfo* p)
+{
+    return p->pss ? p->pss : p->rss;
+}
+
 void ProcessInfo_to_GString(ProcessInfo* p, GString* out)
 {
     float gb = p->rss * PAGE_GB();
     const char* cpu_icon = p->cpu > CPU_HIGH_THRESHOLD ? "📈" : "📉";
     const char* io_icon = p->io_wait < IO_WAIT_THRESHOLD ? "🔄" : "⏳";
-    g_string_append_printf(out, "%s: %s%.2g%%cpu %.2g%%avg %s%.2g%%io 💾%.2ggb 📂%d 🔌%d 🧵%d",
-        p->comm, cpu_icon, max2decs(p->cpu), max2decs(p->average_cpu), io_icon, p->io_wait, gb,
+    g_string_append_printf(out, "%s: %s%.2g%%cpu %.2g/%.2g/%.2g%%(1/5/15m) %.2g%%avg %s%.2g%%io 💾%.2ggb 📂%d 🔌%d 🧵%d",
+        p->comm, cpu_icon, max2decs(p->cpu), max2decs(CPU_LOAD(p, 0)), max2decs(CPU_LOAD(p, 1)),
+        max2decs(CPU_LOAD(p, 2)), max2decs(p->average_cpu), io_icon, p->io_wait, gb,
         p->fd_count, p->socket_count, p->thread_count);
+    if (p->pss)
+        g_string_append_printf(out, " (pss %.2g uss %.2g swap %.2ggb)",
+            p->pss * PAGE_GB(), p->uss * PAGE_GB(), p->swap * PAGE_GB());
     if (p->net_rx_KBps || p->net_tx_KBps)
         g_string_append_printf(out, " ↓%d↑%dKB/s",
             p->net_rx_KBps, p->net_tx_KBps);
@@ -70,54 +122,52 @@ void ProcessInfo_to_GString(ProcessInfo* p, GString* out)
     g_warn_if_fail(p->pid>0);
 }
 
-void top_procs_append_summary(GString* summary)
+// Appends p under icon unless an earlier category already listed it
+static void top_procs_append_one(GString* summary, const char* icon, ProcessInfo* p,
+    ProcessInfo** listed, int* n_listed)
+{
+    if (!p)
+        return;
+    for (int i = 0; i < *n_listed; i++)
+        if (listed[i] == p)
+            return;
+    listed[(*n_listed)++] = p;
+    g_string_append_printf(summary, "\n%s ", icon);
+    ProcessInfo_to_GString(p, summary);
+}
+
+void top_procs_append_summary(GString* summary, int mem_available_MB)
 {
     g_string_append_printf(summary, "\n📊  %d processes, %d active", procs_total, procs_active);
     if (top_cpu) {
-        g_string_append(summary, "\n\n📊  Top consumers:\n🔥 ");
-        ProcessInfo_to_GString(top_cpu, summary);
-        if (top_avg && top_avg != top_cpu) {
-            g_string_append(summary, "\n🔥 ");
-            ProcessInfo_to_GString(top_avg, summary);
-        }
-        if (top_cumulative && top_cumulative != top_avg && top_cumulative != top_cpu) {
-            g_string_append(summary, "\n🔥 ");
-            ProcessInfo_to_GString(top_cumulative, summary);
-        }
-        if (top_io && top_io != top_cumulative && top_io != top_avg && top_io != top_cpu) {
-            g_string_append(summary, "\n🔁 ");
-            ProcessInfo_to_GString(top_io, summary);
-        }
-        if (top_mem && top_mem != top_io && top_mem != top_cumulative
-                && top_mem != top_avg && top_mem != top_cpu) {
-            g_string_append(summary, "\n🧠 ");
-            ProcessInfo_to_GString(top_mem, summary);
-        }
-        if (top_net && (top_net->net_rx_KBps || top_net->net_tx_KBps)
-                && top_net != top_cpu && top_net != top_avg && top_net != top_cumulative
-                && top_net != top_io && top_net != top_mem) {
-            g_string_append(summary, "\n🌐 ");
-            ProcessInfo_to_GString(top_net, summary);
-        }
-        if (top_sockets && top_sockets->socket_count
-                && top_sockets != top_net && top_sockets != top_cpu && top_sockets != top_avg
-                && top_sockets != top_cumulative && top_sockets != top_io && top_sockets != top_mem) {
-            g_string_append(summary, "\n🔌 ");
-            ProcessInfo_to_GString(top_sockets, summary);
-        }
-        if (top_fds && top_fds != top_mem && top_fds != top_io
-                && top_fds != top_cumulative && top_fds != top_avg && top_fds != top_cpu
-                && top_fds != top_net && top_fds != top_sockets) {
-            g_string_append(summary, "\n📂 ");
-            ProcessInfo_to_GString(top_fds, summary);
-        }
-        if (top_threads && top_threads != top_fds && top_threads != top_mem
-                && top_threads != top_io && top_threads != top_cumulative
-                && top_threads != top_avg && top_threads != top_cpu
-                && top_threads != top_net && top_threads != top_sockets) {
-            g_string_append(summary, "\n🧵 ");
-            ProcessInfo_to_GString(top_threads, summary);
-        }
+        ProcessInfo* listed[16];
+        int n = 0;
+        g_string_append(summary, "\n\n📊  Top consumers:");
+        top_procs_append_one(summary, "🔥", top_cpu, listed, &n);
+        top_procs_append_one(summary, "🔥", top_load, listed, &n);
+        top_procs_append_one(summary, "🔥", top_avg, listed, &n);
+        top_procs_append_one(summary, "🔥", top_cumulative, listed, &n);
+        top_procs_append_one(summary, "🔁", top_io, listed, &n);
+        top_procs_append_one(summary, "🧠", top_mem, listed, &n);
+        if (top_net && (top_net->net_rx_KBps || top_net->net_tx_KBps))
+            top_procs_append_one(summary, "🌐", top_net, listed, &n);
+        if (top_sockets && top_sockets->socket_count)
+            top_procs_append_one(summary, "🔌", top_sockets, listed, &n);
+        top_procs_append_one(summary, "📂", top_fds, listed, &n);
+        top_procs_append_one(summary, "🧵", top_threads, listed, &n);
+    }
+    // Always shown when someone grows: who, how fast, and how long until
+    // available memory runs out at that pace
+    float growth = top_growth ? ProcessInfo_growth_MB_min(top_growth) : 0;
+    if (growth >= RSS_TREND_MIN_MB_MIN) {
+        g_string_append_printf(summary, "\n🎈 %s (%u) grows %.3gMB/min", top_growth->comm, top_growth->pid, growth);
+        float minutes = mem_available_MB / growth;
+        if (minutes < 120)
+            g_string_append_printf(summary, ", fills RAM in %.0f min", minutes);
+        else if (minutes < 48*60)
+            g_string_append_printf(summary, ", fills RAM in %.1f h", minutes / 60);
+        else
+            g_string_append_printf(summary, ", fills RAM in %.0f days", minutes / (24*60));
     }
     if (procs_self) {
         g_string_append(summary, "\n\n");
@@ -131,13 +181,16 @@ ProcessInfo ProcessInfo_scan(const char* pid)
     pi.pid = atoi(pid);
     char buf[512];
     sprintf(buf, "/proc/%s/stat", pid);
-    FILE* f = fopen(buf, "r");
-    if (!f) {
+    // Plain read(): one syscall and no stdio buffer for a file this small
+    int fd = root_open(buf);
+    if (fd < 0) {
         strcpy(pi.comm, "(defunct)");
         return pi;
     }
-    int len = fread(buf, 1, sizeof(buf)-1, f);
-    fclose(f);
+    int len = read(fd, buf, sizeof(buf)-1);
+    close(fd);
+    if (len < 0)
+        len = 0;
     buf[len] = '\0';
 
     // Extract executable name, handling extra parentheses e.g. ((sd-pam))
@@ -180,15 +233,49 @@ ProcessInfo ProcessInfo_scan(const char* pid)
 
     // Calculate CPU average since process started
     read_field(22, starttime);
+    pi.starttime = starttime;
     pi.average_cpu = pi.cpu_time * 100.0 / (cpu_total_ticks - starttime);
 
-    read_field(24, rss); pi.rss = rss; // TODO: Discount shared memory
+    read_field(24, rss); pi.rss = rss; // Shared memory is discounted by ProcessInfo_scan_smaps()
     read_field(42, delayacct_blkio_ticks); pi.io_time = delayacct_blkio_ticks;
 
     pi.sample_time = cpu_total_ticks;
     return pi;
 }
 
+// Reads Pss, USS (private clean + dirty) and Swap. Processes of other users
+// are usually unreadable: they keep ranking by rss.
+void ProcessInfo_scan_smaps(ProcessInfo* p)
+{
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "/proc/%u/smaps_rollup", p->pid);
+    p->smaps_us = g_get_monotonic_time();
+    int fd = root_open(buf);
+    int len = fd >= 0 ? read(fd, buf, sizeof(buf)-1) : -1;
+    if (fd >= 0)
+        close(fd);
+    p->pss = p->uss = p->swap = 0;
+    if (len <= 0)
+        return;
+    buf[len] = '\0';
+
+    const float kb_pages = 1.0f / (PAGE_GB() * (1<<20));
+    for (char* line = buf; line; line = strchr(line, '\n')) {
+        while (*line == '\n')
+            line++;
+        unsigned kb;
+        char key[32];
+        if (sscanf(line, "%31[^:]: %u kB", key, &kb) != 2)
+            continue;
+        if (!strcmp(key, "Pss"))
+            p->pss = MAX(kb * kb_pages, 1); // Non-zero marks it sampled
+        else if (!strcmp(key, "Private_Clean") || !strcmp(key, "Private_Dirty"))
+            p->uss += kb * kb_pages;
+        else if (!strcmp(key, "Swap"))
+            p->swap = kb * kb_pages;
+    }
+}
+
 void ProcessInfo_update(ProcessInfo* pi, ProcessInfo* update)
 {
     float percent_time = 100.0 / (update->sample_time - pi->sample_time);
@@ -201,49 +288,83 @@ void ProcessInfo_update(ProcessInfo* pi, ProcessInfo* update)
     update->net_rx_KBps = pi->net_rx_KBps;
     update->net_tx_KBps = pi->net_tx_KBps;
     update->min_rtt_us = pi->min_rtt_us;
+    // smaps_rollup figures belong to the process, not to a reused pid
+    gboolean same = update->starttime == pi->starttime;
+    update->pss = same ? pi->pss : 0;
+    update->uss = same ? pi->uss : 0;
+    update->swap = same ? pi->swap : 0;
+    update->smaps_us = same ? pi->smaps_us : 0;
+    update->rss_trend = same ? pi->rss_trend : 0;
+    for (int w = 0; w < 3; w++)
+        update->cpu_load[w] = same ? pi->cpu_load[w] : 0;
     void* next = pi->next;
     *pi = *update;
     pi->next = next;
 }
 
-void top_procs_refresh(void)
+// Called every tick with the real time since the previous one. The top cadence
+// stretches along with the adaptive tick interval (see sched.c).
+void top_procs_refresh(int tick_ms)
 {
-    static int delay = 0;
-    if (--delay > 0)
+    static int accum_ms = -1; // First call scans right away
+    int due_ms = (gint64)top_refresh_ms * MAX(sched_interval_ms, refresh_interval_ms) / refresh_interval_ms;
+    if (accum_ms >= 0 && (accum_ms += tick_ms) < due_ms)
         return;
-    int elapsed_ms = top_refresh_ms;
-    delay = top_refresh_ms/refresh_interval_ms;
+    int elapsed_ms = MAX(accum_ms, tick_ms);
+    accum_ms = 0;
 
     // Heavy work (inet_diag netlink + per-pid fd readlinks + socket aggregation)
-    // runs on its own slower cadence to keep idle CPU low.
+    // runs on its own slower cadence to keep idle CPU low. A heavy pass walks
+    // pids in ascending order from heavy_cursor, at most heavy_slice per tick,
+    // so its cost is spread over the ticks until the next pass is due.
     static int heavy_accum_ms = 0;
+    static gboolean heavy = FALSE;
+    static unsigned heavy_cursor = 0;
+    int heavy_due_ms = (gint64)heavy_refresh_ms * due_ms / top_refresh_ms;
     heavy_accum_ms += elapsed_ms;
-    gboolean heavy = heavy_accum_ms >= heavy_refresh_ms;
-    int heavy_elapsed_ms = heavy_accum_ms;
-    if (heavy) heavy_accum_ms = 0;
+    if (!heavy && heavy_accum_ms >= heavy_due_ms) {
+        heavy = TRUE;
+        heavy_cursor = 0;
+        heavy_accum_ms = 0;
+        net_inode_map_clear();
+    }
+    int heavy_slice = heavy_slice_pids ? heavy_slice_pids
+        : procs_total ? (gint64)procs_total * due_ms / MAX(heavy_due_ms, 1) + 1 : G_MAXINT;
+    if (!heavy)
+        heavy_slice = 0;
 
-    net_stats_refresh(heavy);
-    static GDir* proc_dir = NULL;
+    gint64 walk_t0 = prof_now_ns(), fd_ns = 0;
+    static DIR* proc_dir = NULL;
     int find_my_pid = 0;
     if (proc_dir) {
-        g_dir_rewind(proc_dir);
+        rewinddir(proc_dir);
     } else {
-        find_my_pid = getpid();
-        proc_dir = g_dir_open ("/proc", 0, NULL);
+        // Our pid as seen by the monitored procfs, which may be the host's
+        char self[16];
+        int len = root_readlink("/proc/self", self, sizeof(self)-1);
+        find_my_pid = len > 0 ? (self[len] = '\0', atoi(self)) : getpid();
+        if (!(proc_dir = root_opendir("/proc")))
+            return;
     }
 
     // Reset top process pointers
     top_cpu = top_mem = top_avg = top_io = top_cumulative = top_fds = top_threads = top_net = top_sockets = NULL;
+    top_growth = top_load = NULL;
+    const guint32* load_decay = cpu_load_decay(elapsed_ms);
+
+    // Weight of this walk's rss delta in rss_trend, 16.16 fixed point: the
+    // first-order approximation of 1 - exp(-elapsed/tau), fine for elapsed << tau
+    const gint64 trend_alpha = ((gint64)elapsed_ms << 16) / (RSS_TREND_TAU_MS + elapsed_ms);
 
     // iterator pointers
     ProcessInfo **it = &top_procs, *p = *it;
+    ProcessInfo* smaps_candidates[SMAPS_CANDIDATES] = {NULL}; // Largest rss first
 
-    if (heavy) net_inode_map_clear();
-
-    const gchar* pid;
+    struct dirent* entry;
     procs_total = procs_active = 0;
-    while ((pid = g_dir_read_name(proc_dir)))
+    while ((entry = readdir(proc_dir)))
     {
+        const char* pid = entry->d_name;
         if (pid[0] < '0' || pid[0] > '9')
             continue;
         ++procs_total;
@@ -265,8 +386,18 @@ void top_procs_refresh(void)
         }
         if (p) {
             g_debug("Updating process %d (%s)", p->pid, p->comm);
+            unsigned prev_rss = p->rss;
+            gboolean same = p->starttime == proc.starttime;
             ProcessInfo_update(p, &proc);
             procs_active += !!p->cpu;
+            if (same) {
+                gint64 rate = ((gint64)p->rss - prev_rss) * (60000 << 8) / MAX(elapsed_ms, 1);
+                p->rss_trend += (rate - p->rss_trend) * trend_alpha >> 16;
+                guint64 cpu = p->cpu * 65536;
+                for (int w = 0; w < 3; w++)
+                    p->cpu_load[w] = ((guint64)p->cpu_load[w] * load_decay[w]
+                        + cpu * (65536 - load_decay[w])) >> 16;
+            }
         } else {
             // reached end of the list, add new
             *it = p = malloc(sizeof(proc));
@@ -277,12 +408,19 @@ void top_procs_refresh(void)
             p->fd_count = p->socket_count = 0;
             p->net_rx_KBps = p->net_tx_KBps = 0;
             p->min_rtt_us = 0;
+            p->pss = p->uss = p->swap = 0;
+            p->smaps_us = 0;
+            p->rss_trend = 0;
+            memset(p->cpu_load, 0, sizeof(p->cpu_load));
             g_debug("Added process %d (%s)", p->pid, p->comm);
             if (find_my_pid && p->pid == find_my_pid)
                 procs_self = p;
         }
 
-        if (heavy) {
+        gint64 fd_t0 = prof_now_ns();
+        if (heavy_slice && p->pid > heavy_cursor) {
+            --heavy_slice;
+            heavy_cursor = p->pid;
             int sock_count;
             p->fd_count = net_collect_pid_sockets(pid, p->pid, &sock_count);
             p->socket_count = sock_count;
@@ -297,11 +435,23 @@ void top_procs_refresh(void)
             }
         } else {
             p->fd_count = net_count_pid_fds(pid);
-            // socket_count, net_rx/tx_KBps, min_rtt_us persist from last heavy tick
+            // socket_count, net_rx/tx_KBps, min_rtt_us persist from last heavy visit
         }
+        fd_ns += prof_now_ns() - fd_t0;
 
-        if (!top_mem || proc.rss > top_mem->rss)
+        if (!top_mem || ProcessInfo_mem(p) > ProcessInfo_mem(top_mem))
             top_mem = p;
+        int c = SMAPS_CANDIDATES;
+        while (c > 0 && (!smaps_candidates[c-1] || p->rss > smaps_candidates[c-1]->rss))
+            --c;
+        if (c < SMAPS_CANDIDATES) {
+            memmove(&smaps_candidates[c+1], &smaps_candidates[c], (SMAPS_CANDIDATES-1-c) * sizeof(p));
+            smaps_candidates[c] = p;
+        }
+        if (!top_growth || p->rss_trend > top_growth->rss_trend)
+            top_growth = p;
+        if (!top_load || p->cpu_load[1] > top_load->cpu_load[1])
+            top_load = p;
         if (!top_avg || proc.average_cpu > top_avg->average_cpu)
             top_avg = p;
         if (!top_cpu || proc.cpu > top_cpu->cpu)
@@ -321,7 +471,38 @@ void top_procs_refresh(void)
 
         p = *(it = &(p->next));
     }
-    if (heavy) net_stats_aggregate(heavy_elapsed_ms);
+    prof_add(PS_FD_COLLECT, fd_ns);
+    prof_end(PS_PROC_WALK, walk_t0);
+
+    // Refresh the stalest smaps_rollup figures among the largest processes
+    gint64 smaps_t0 = prof_now_ns(), now_us = g_get_monotonic_time();
+    gboolean smaps_read = FALSE;
+    for (int slice = 0; slice < SMAPS_SLICE; slice++) {
+        ProcessInfo* stalest = NULL;
+        for (int c = 0; c < SMAPS_CANDIDATES && smaps_candidates[c]; c++) {
+            ProcessInfo* cand = smaps_candidates[c];
+            if (now_us - cand->smaps_us >= heavy_refresh_ms * 1000LL
+                    && (!stalest || cand->smaps_us < stalest->smaps_us))
+                stalest = cand;
+        }
+        if (!stalest)
+            break;
+        ProcessInfo_scan_smaps(stalest);
+        smaps_read = TRUE;
+    }
+    if (smaps_read) {
+        prof_end(PS_SMAPS, smaps_t0);
+        // Fresh figures may reorder the top; *it ends the pids walked now
+        for (ProcessInfo* q = top_mem = top_procs; q != *it; q = q->next)
+            if (ProcessInfo_mem(q) > ProcessInfo_mem(top_mem))
+                top_mem = q;
+    }
+
+    // Slice budget left over means the walk reached the last pid: pass complete
+    if (heavy && heavy_slice) {
+        net_stats_refresh();
+        heavy = FALSE;
+    }
 
     // Self CPU/IO: 10-second rolling average to avoid the misleading
     // narrow-window self-measurement that includes our own refresh burst.